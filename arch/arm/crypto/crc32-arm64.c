@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * crc32-arm64.c - CRC32 using the ARMv8 CRC32 instructions
+ *
+ * The CRC32 instructions are optional in ARMv8.0 and mandatory from
+ * ARMv8.1 on, so their presence is checked at runtime.
+ */
+
+#include <common.h>
+#include <crc.h>
+#include <init.h>
+#include <asm/sysreg.h>
+#include <asm/byteorder.h>
+#include <crypto/crc.h>
+
+#define ID_AA64ISAR0_CRC32_SHIFT	16
+
+static bool crc32_use_insns;
+
+#define CRC32_INSN(insn, reg, type)					\
+static inline u32 __##insn(u32 crc, type data)				\
+{									\
+	asm(".arch_extension crc\n"					\
+	    #insn " %w0, %w0, %" #reg "1" : "+r" (crc) : "r" (data));	\
+	return crc;							\
+}
+
+CRC32_INSN(crc32x, x, u64)
+CRC32_INSN(crc32w, w, u32)
+CRC32_INSN(crc32h, w, u16)
+CRC32_INSN(crc32b, w, u8)
+
+static u32 crc32_arm64(u32 crc, const u8 *p, unsigned int len)
+{
+	/* align to 8 bytes, all loads below are aligned then */
+	while (len && ((unsigned long)p & 7)) {
+		crc = __crc32b(crc, *p++);
+		len--;
+	}
+
+	while (len >= 8) {
+		crc = __crc32x(crc, le64_to_cpup((const __le64 *)p));
+		p += 8;
+		len -= 8;
+	}
+
+	if (len & 4) {
+		crc = __crc32w(crc, le32_to_cpup((const __le32 *)p));
+		p += 4;
+	}
+
+	if (len & 2) {
+		crc = __crc32h(crc, le16_to_cpup((const __le16 *)p));
+		p += 2;
+	}
+
+	if (len & 1)
+		crc = __crc32b(crc, *p);
+
+	return crc;
+}
+
+uint32_t crc32_le_arch(uint32_t crc, const void *buf, unsigned int len)
+{
+	if (!crc32_use_insns)
+		return crc32_le_generic(crc, buf, len);
+
+	return crc32_arm64(crc, buf, len);
+}
+
+static int crc32_arm64_init(void)
+{
+	u64 isar0 = read_sysreg(id_aa64isar0_el1);
+
+	if (!((isar0 >> ID_AA64ISAR0_CRC32_SHIFT) & 0xf))
+		return 0;
+
+	crc32_use_insns = true;
+
+	if (IS_ENABLED(CONFIG_DIGEST_CRC32_GENERIC))
+		return crc32_digest_register_arch("crc32-arm64");
+
+	return 0;
+}
+pure_initcall(crc32_arm64_init);
@@ -52,6 +52,13 @@ int tap_alloc(const char *dev)
 		return err;
 	}
 
+	/* the driver reads until no more packets are queued */
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+		perror("could not set tap device non-blocking");
+		close(fd);
+		return -1;
+	}
+
 	return fd;
 }
 
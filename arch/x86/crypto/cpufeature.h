@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * CPUID checks for the instruction set extensions used by the crypto
+ * routines. These are shared with sandbox builds on x86_64 hosts, so only
+ * generic headers may be used here.
+ */
+
+#ifndef __X86_CRYPTO_CPUFEATURE_H
+#define __X86_CRYPTO_CPUFEATURE_H
+
+#include <linux/bits.h>
+#include <linux/types.h>
+
+struct x86_cpuid_regs {
+	u32 eax, ebx, ecx, edx;
+};
+
+static inline void x86_cpuid(u32 leaf, u32 subleaf, struct x86_cpuid_regs *r)
+{
+	asm volatile("cpuid"
+		     : "=a" (r->eax), "=b" (r->ebx), "=c" (r->ecx), "=d" (r->edx)
+		     : "a" (leaf), "c" (subleaf));
+}
+
+static inline u32 x86_cpuid_max_leaf(void)
+{
+	struct x86_cpuid_regs r;
+
+	x86_cpuid(0, 0, &r);
+
+	return r.eax;
+}
+
+static inline bool x86_has_pclmulqdq(void)
+{
+	struct x86_cpuid_regs r;
+
+	x86_cpuid(1, 0, &r);
+
+	return r.ecx & BIT(1);
+}
+
+/* SHA extensions, plus the SSSE3 and SSE4.1 instructions used around them */
+static inline bool x86_has_sha_ni(void)
+{
+	struct x86_cpuid_regs r;
+
+	if (x86_cpuid_max_leaf() < 7)
+		return false;
+
+	x86_cpuid(1, 0, &r);
+	if (!(r.ecx & BIT(9)) || !(r.ecx & BIT(19)))
+		return false;
+
+	x86_cpuid(7, 0, &r);
+
+	return r.ebx & BIT(29);
+}
+
+/*
+ * AVX2 and BMI2. The ymm registers are only usable if the firmware or the
+ * OS enabled saving them, which is what OSXSAVE and XCR0 tell us.
+ */
+static inline bool x86_has_avx2_bmi2(void)
+{
+	struct x86_cpuid_regs r;
+	u32 xcr0_lo, xcr0_hi;
+
+	if (x86_cpuid_max_leaf() < 7)
+		return false;
+
+	x86_cpuid(1, 0, &r);
+	if (!(r.ecx & BIT(27)))
+		return false;
+
+	asm volatile("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0_lo & 0x6) != 0x6)
+		return false;
+
+	x86_cpuid(7, 0, &r);
+
+	return (r.ebx & BIT(5)) && (r.ebx & BIT(8));
+}
+
+#endif /* __X86_CRYPTO_CPUFEATURE_H */
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * crc32-pclmul-glue.c - CRC32 using the PCLMULQDQ instruction
+ */
+
+#include <common.h>
+#include <crc.h>
+#include <init.h>
+#include <linux/linkage.h>
+#include <crypto/crc.h>
+
+#include "cpufeature.h"
+
+/* below this, the table driven implementation is faster */
+#define CRC32_PCLMUL_MIN_LEN	64
+
+asmlinkage u32 crc32_pclmul_le_16(const void *buf, size_t len, u32 crc);
+
+static bool crc32_use_pclmul;
+
+uint32_t crc32_le_arch(uint32_t crc, const void *buf, unsigned int len)
+{
+	unsigned int now;
+
+	if (!crc32_use_pclmul || len < CRC32_PCLMUL_MIN_LEN)
+		return crc32_le_generic(crc, buf, len);
+
+	now = len & ~15;
+	crc = crc32_pclmul_le_16(buf, now, crc);
+
+	return crc32_le_generic(crc, buf + now, len - now);
+}
+
+static int crc32_pclmul_init(void)
+{
+	if (!x86_has_pclmulqdq())
+		return 0;
+
+	crc32_use_pclmul = true;
+
+	if (IS_ENABLED(CONFIG_DIGEST_CRC32_GENERIC))
+		return crc32_digest_register_arch("crc32-pclmul");
+
+	return 0;
+}
+pure_initcall(crc32_pclmul_init);
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha1-ni-glue.c - SHA-1 using the SHA extensions
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/sha1_base.h>
+#include <crypto/internal.h>
+#include <linux/linkage.h>
+
+#include "cpufeature.h"
+
+/* struct sha1_state starts with the u32 state[5] the routine expects */
+asmlinkage void sha1_ni_transform(struct sha1_state *sst, u8 const *src,
+				  int blocks);
+
+static int sha1_ni_update(struct digest *desc, const void *data,
+			  unsigned long len)
+{
+	return sha1_base_do_update(desc, data, len, sha1_ni_transform);
+}
+
+static int sha1_ni_final(struct digest *desc, u8 *out)
+{
+	sha1_base_do_finalize(desc, sha1_ni_transform);
+	return sha1_base_finish(desc, out);
+}
+
+static struct digest_algo sha1_ni = {
+	.base = {
+		.name		=	"sha1",
+		.driver_name	=	"sha1-ni",
+		.priority	=	300,
+		.algo		=	HASH_ALGO_SHA1,
+	},
+
+	.init	=	sha1_base_init,
+	.update	=	sha1_ni_update,
+	.final	=	sha1_ni_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.length	=	SHA1_DIGEST_SIZE,
+	.ctx_length =	sizeof(struct sha1_state),
+};
+
+static int sha1_ni_digest_register(void)
+{
+	if (!x86_has_sha_ni())
+		return 0;
+
+	return digest_algo_register(&sha1_ni);
+}
+coredevice_initcall(sha1_ni_digest_register);
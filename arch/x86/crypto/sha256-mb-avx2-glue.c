@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha256-mb-avx2-glue.c - multi-buffer SHA-256 using AVX2
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_mb.h>
+#include <linux/linkage.h>
+
+#include "cpufeature.h"
+
+#define SHA256_MB_AVX2_LANES	8
+
+asmlinkage void sha256_mb_avx2_transform(struct sha256_mb_state *st,
+					 const u8 *data[SHA256_MB_MAX_LANES],
+					 int blocks);
+
+/* finishes the last message when the other lanes have run dry */
+asmlinkage void sha256_avx2_transform(struct sha256_state *sst, u8 const *src,
+				      int blocks);
+
+static int sha256_mb_avx2_digest(struct digest_mb_req *reqs, unsigned int num)
+{
+	return sha256_mb_digest(reqs, num, SHA256_MB_AVX2_LANES,
+				sha256_mb_avx2_transform,
+				sha256_avx2_transform);
+}
+
+static struct digest_mb_algo sha256_mb_avx2 = {
+	.base = {
+		.name		=	"sha256",
+		.driver_name	=	"sha256-mb-avx2",
+		/* above sha256-avx2, below sha256-ni */
+		.priority	=	250,
+		.algo		=	HASH_ALGO_SHA256,
+	},
+
+	.digest	=	sha256_mb_avx2_digest,
+};
+
+static int sha256_mb_avx2_register(void)
+{
+	if (!x86_has_avx2_bmi2())
+		return 0;
+
+	return digest_mb_algo_register(&sha256_mb_avx2);
+}
+coredevice_initcall(sha256_mb_avx2_register);
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha256-x86-glue.c - SHA-224/SHA-256 using the SHA extensions or AVX2
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <init.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_base.h>
+#include <crypto/internal.h>
+#include <linux/linkage.h>
+
+#include "cpufeature.h"
+
+/* struct sha256_state starts with the u32 state[8] the routines expect */
+asmlinkage void sha256_ni_transform(struct sha256_state *sst, u8 const *src,
+				    int blocks);
+asmlinkage void sha256_avx2_transform(struct sha256_state *sst, u8 const *src,
+				      int blocks);
+
+static int sha256_ni_update(struct digest *desc, const void *data,
+			    unsigned long len)
+{
+	return sha256_base_do_update(desc, data, len, sha256_ni_transform);
+}
+
+static int sha256_ni_final(struct digest *desc, u8 *out)
+{
+	sha256_base_do_finalize(desc, sha256_ni_transform);
+	return sha256_base_finish(desc, out);
+}
+
+static int sha256_avx2_update(struct digest *desc, const void *data,
+			      unsigned long len)
+{
+	return sha256_base_do_update(desc, data, len, sha256_avx2_transform);
+}
+
+static int sha256_avx2_final(struct digest *desc, u8 *out)
+{
+	sha256_base_do_finalize(desc, sha256_avx2_transform);
+	return sha256_base_finish(desc, out);
+}
+
+static struct digest_algo sha224_ni = {
+	.base = {
+		.name		=	"sha224",
+		.driver_name	=	"sha224-ni",
+		.priority	=	300,
+		.algo		=	HASH_ALGO_SHA224,
+	},
+
+	.length	=	SHA224_DIGEST_SIZE,
+	.init	=	sha224_base_init,
+	.update	=	sha256_ni_update,
+	.final	=	sha256_ni_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static struct digest_algo sha256_ni = {
+	.base = {
+		.name		=	"sha256",
+		.driver_name	=	"sha256-ni",
+		.priority	=	300,
+		.algo		=	HASH_ALGO_SHA256,
+	},
+
+	.length	=	SHA256_DIGEST_SIZE,
+	.init	=	sha256_base_init,
+	.update	=	sha256_ni_update,
+	.final	=	sha256_ni_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static struct digest_algo sha224_avx2 = {
+	.base = {
+		.name		=	"sha224",
+		.driver_name	=	"sha224-avx2",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA224,
+	},
+
+	.length	=	SHA224_DIGEST_SIZE,
+	.init	=	sha224_base_init,
+	.update	=	sha256_avx2_update,
+	.final	=	sha256_avx2_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static struct digest_algo sha256_avx2 = {
+	.base = {
+		.name		=	"sha256",
+		.driver_name	=	"sha256-avx2",
+		.priority	=	200,
+		.algo		=	HASH_ALGO_SHA256,
+	},
+
+	.length	=	SHA256_DIGEST_SIZE,
+	.init	=	sha256_base_init,
+	.update	=	sha256_avx2_update,
+	.final	=	sha256_avx2_final,
+	.digest	=	digest_generic_digest,
+	.verify	=	digest_generic_verify,
+	.ctx_length =	sizeof(struct sha256_state),
+};
+
+static int sha256_x86_digest_register(void)
+{
+	int ret;
+
+	/* both are registered if possible, the priority picks the default */
+	if (x86_has_sha_ni()) {
+		ret = digest_algo_register(&sha224_ni);
+		if (ret)
+			return ret;
+
+		ret = digest_algo_register(&sha256_ni);
+		if (ret)
+			return ret;
+	}
+
+	if (x86_has_avx2_bmi2()) {
+		ret = digest_algo_register(&sha224_avx2);
+		if (ret)
+			return ret;
+
+		ret = digest_algo_register(&sha256_avx2);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+coredevice_initcall(sha256_x86_digest_register);
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * The UEFI calling convention expects xmm6-xmm15 to be preserved, while
+ * the System V ABI barebox is built for treats them as scratch registers.
+ * As barebox itself is built without SSE, the routines using them save
+ * and restore them around their work.
+ */
+
+#ifndef __X86_CRYPTO_SIMD_REGS_H
+#define __X86_CRYPTO_SIMD_REGS_H
+
+#define XMM_SAVE_SIZE	(10 * 16)
+
+/* save xmm6-xmm15 to \offset(%rsp) */
+.macro save_xmm6_15 offset=0
+	movdqu	%xmm6,  \offset + 0x00(%rsp)
+	movdqu	%xmm7,  \offset + 0x10(%rsp)
+	movdqu	%xmm8,  \offset + 0x20(%rsp)
+	movdqu	%xmm9,  \offset + 0x30(%rsp)
+	movdqu	%xmm10, \offset + 0x40(%rsp)
+	movdqu	%xmm11, \offset + 0x50(%rsp)
+	movdqu	%xmm12, \offset + 0x60(%rsp)
+	movdqu	%xmm13, \offset + 0x70(%rsp)
+	movdqu	%xmm14, \offset + 0x80(%rsp)
+	movdqu	%xmm15, \offset + 0x90(%rsp)
+.endm
+
+.macro restore_xmm6_15 offset=0
+	movdqu	\offset + 0x00(%rsp), %xmm6
+	movdqu	\offset + 0x10(%rsp), %xmm7
+	movdqu	\offset + 0x20(%rsp), %xmm8
+	movdqu	\offset + 0x30(%rsp), %xmm9
+	movdqu	\offset + 0x40(%rsp), %xmm10
+	movdqu	\offset + 0x50(%rsp), %xmm11
+	movdqu	\offset + 0x60(%rsp), %xmm12
+	movdqu	\offset + 0x70(%rsp), %xmm13
+	movdqu	\offset + 0x80(%rsp), %xmm14
+	movdqu	\offset + 0x90(%rsp), %xmm15
+.endm
+
+#endif /* __X86_CRYPTO_SIMD_REGS_H */
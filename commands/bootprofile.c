@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* bootprofile.c - show where the boot time goes */
+
+#include <common.h>
+#include <boot-profile.h>
+#include <clock.h>
+#include <command.h>
+#include <getopt.h>
+#include <linux/err.h>
+
+static int do_bootprofile(int argc, char *argv[])
+{
+	const char *tracefile = NULL;
+	unsigned flags = 0;
+	u64 min_ns = 0;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "sdm:o:")) > 0) {
+		switch (opt) {
+		case 's':
+			flags |= BOOT_PROFILE_SUMMARY;
+			break;
+		case 'd':
+			flags |= BOOT_PROFILE_SORT;
+			break;
+		case 'm':
+			min_ns = simple_strtoull(optarg, NULL, 0) * USECOND;
+			break;
+		case 'o':
+			tracefile = optarg;
+			break;
+		default:
+			return COMMAND_ERROR_USAGE;
+		}
+	}
+
+	if (argc != optind)
+		return COMMAND_ERROR_USAGE;
+
+	if (tracefile) {
+		ret = boot_profile_write_trace(tracefile);
+		if (ret) {
+			printf("Cannot write %s: %pe\n", tracefile, ERR_PTR(ret));
+			return COMMAND_ERROR;
+		}
+
+		return 0;
+	}
+
+	boot_profile_print(flags, min_ns);
+
+	return 0;
+}
+
+BAREBOX_CMD_HELP_START(bootprofile)
+BAREBOX_CMD_HELP_TEXT("Show the start time, duration and result of every initcall, every")
+BAREBOX_CMD_HELP_TEXT("device probe and every round of the deferred probe loop until the")
+BAREBOX_CMD_HELP_TEXT("initcalls are done, followed by the total time spent in each of them.")
+BAREBOX_CMD_HELP_TEXT("")
+BAREBOX_CMD_HELP_TEXT("Options:")
+BAREBOX_CMD_HELP_OPT ("-s",	  "sum up events per initcall and device")
+BAREBOX_CMD_HELP_OPT ("-d",	  "sort by duration, longest first")
+BAREBOX_CMD_HELP_OPT ("-m USECS", "skip events shorter than USECS microseconds")
+BAREBOX_CMD_HELP_OPT ("-o FILE",  "write trace in the Chrome Trace Event Format to FILE")
+BAREBOX_CMD_HELP_END
+
+BAREBOX_CMD_START(bootprofile)
+	.cmd		= do_bootprofile,
+	BAREBOX_CMD_DESC("show boot time profile")
+	BAREBOX_CMD_OPTS("[-sdm USECS] [-o FILE]")
+	BAREBOX_CMD_GROUP(CMD_GRP_INFO)
+	BAREBOX_CMD_HELP(cmd_bootprofile_help)
+BAREBOX_CMD_END
@@ -12,6 +12,7 @@
 #include <digest.h>
 #include <getopt.h>
 #include <libfile.h>
+#include <linux/err.h>
 
 #include "internal.h"
 
@@ -80,6 +81,40 @@ static void __maybe_unused prints_algo_help(void)
 	digest_algo_prints("\t");
 }
 
+#define DIGEST_BENCH_MAX_SIZES	16
+
+static int do_digest_bench(const char *algo, char *sizes,
+			   unsigned int align, unsigned int min_time_ms)
+{
+	unsigned int size[DIGEST_BENCH_MAX_SIZES];
+	struct digest_bench_params params = {
+		.sizes = size,
+		.align = align,
+		.min_time_ms = min_time_ms,
+	};
+	char *str;
+	int ret;
+
+	while (sizes && (str = strsep(&sizes, ","))) {
+		if (params.num_sizes == ARRAY_SIZE(size)) {
+			eprintf("too many sizes\n");
+			return COMMAND_ERROR_USAGE;
+		}
+
+		size[params.num_sizes++] = strtoul_suffix(str, NULL, 0);
+	}
+
+	ret = digest_bench(algo, &params);
+	if (ret == -ENOENT)
+		eprintf("algo '%s' not found\n", algo ?: "*");
+	else if (ret == -EINVAL)
+		eprintf("sizes must be non-zero and ascending\n");
+	else if (ret && ret != -EINTR)
+		eprintf("benchmark failed: %pe\n", ERR_PTR(ret));
+
+	return ret ? COMMAND_ERROR : COMMAND_SUCCESS;
+}
+
 static int do_digest(int argc, char *argv[])
 {
 	struct digest *d;
@@ -93,14 +128,29 @@ static int do_digest(int argc, char *argv[])
 	size_t keylen = 0;
 	size_t digestlen = 0;
 	char *algo = NULL;
+	bool bench = false;
+	char *bench_sizes = NULL;
+	unsigned int bench_align = 0, bench_time_ms = 0;
 	int opt;
 	int ret = COMMAND_ERROR;
 
 	if (argc < 2)
 		return COMMAND_ERROR_USAGE;
 
-	while((opt = getopt(argc, argv, "a:k:K:s:S:")) > 0) {
+	while((opt = getopt(argc, argv, "a:bk:K:s:S:l:O:t:")) > 0) {
 		switch(opt) {
+		case 'b':
+			bench = true;
+			break;
+		case 'l':
+			bench_sizes = optarg;
+			break;
+		case 'O':
+			bench_align = simple_strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			bench_time_ms = simple_strtoul(optarg, NULL, 0);
+			break;
 		case 'k':
 			key = optarg;
 			keylen = strlen(key);
@@ -121,6 +171,10 @@ static int do_digest(int argc, char *argv[])
 		}
 	}
 
+	if (bench)
+		return do_digest_bench(algo, bench_sizes, bench_align,
+				       bench_time_ms);
+
 	if (!algo)
 		return COMMAND_ERROR_USAGE;
 
@@ -195,6 +249,15 @@ BAREBOX_CMD_HELP_OPT ("-k <key>\t",   "use supplied <key> (ASCII or hex) for MAC
 BAREBOX_CMD_HELP_OPT ("-K <file>\t",  "use key from <file> (binary) for MAC")
 BAREBOX_CMD_HELP_OPT ("-s <hex>\t",   "verify data against supplied <hex> (hash, MAC or signature)")
 BAREBOX_CMD_HELP_OPT ("-S <file>\t",  "verify data against <file> (hash, MAC or signature)")
+#ifdef CONFIG_DIGEST_BENCH
+BAREBOX_CMD_HELP_TEXT("")
+BAREBOX_CMD_HELP_TEXT("With -b, measure the speed of <algo>, or of all digests if")
+BAREBOX_CMD_HELP_TEXT("no -a is given, instead of calculating a digest.")
+BAREBOX_CMD_HELP_OPT ("-b\t",         "benchmark mode")
+BAREBOX_CMD_HELP_OPT ("-l <sizes>\t", "comma separated, ascending buffer sizes for -b")
+BAREBOX_CMD_HELP_OPT ("-O <offset>\t", "buffer offset from a 64 byte boundary for -b")
+BAREBOX_CMD_HELP_OPT ("-t <ms>\t",    "minimum duration of each measurement for -b")
+#endif
 BAREBOX_CMD_HELP_END
 
 BAREBOX_CMD_START(digest)
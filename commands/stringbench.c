@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <common.h>
+#include <command.h>
+#include <clock.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <string.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+
+/* keeps the results of the benchmarked functions from being discarded */
+static volatile size_t stringbench_sink;
+
+static void stringbench_print(const char *name, size_t size,
+			      unsigned int loops, u64 ns)
+{
+	printf("%-24s %8llu KiB/s\n", name,
+	       div64_u64((u64)size * loops * SECOND, ns ?: 1) / SZ_1K);
+}
+
+#define stringbench(name, expr) do {				\
+	unsigned int __i;					\
+	u64 __start = get_time_ns();				\
+	for (__i = 0; __i < loops; __i++)			\
+		expr;						\
+	stringbench_print(name, size, loops, get_time_ns() - __start); \
+} while (0)
+
+static int do_stringbench(int argc, char *argv[])
+{
+	size_t size = SZ_1M;
+	unsigned int loops = 16;
+	u8 *a, *b;
+	int opt, ret = COMMAND_ERROR;
+
+	while ((opt = getopt(argc, argv, "s:l:")) > 0) {
+		switch (opt) {
+		case 's':
+			size = strtoul_suffix(optarg, NULL, 0);
+			break;
+		case 'l':
+			loops = simple_strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return COMMAND_ERROR_USAGE;
+		}
+	}
+
+	if (!size || !loops)
+		return COMMAND_ERROR_USAGE;
+
+	/* one spare byte for the unaligned source and the string terminator */
+	a = malloc(size + 1);
+	b = malloc(size + 1);
+	if (!a || !b) {
+		eprintf("cannot allocate 2 * %zu bytes\n", size + 1);
+		goto out;
+	}
+
+	memset(a, 0x5a, size + 1);
+	memset(b, 0x5a, size + 1);
+	a[size] = b[size] = '\0';
+
+	stringbench("memcpy", memcpy(a, b, size));
+	stringbench("memcpy unaligned", memcpy(a, b + 1, size));
+	stringbench("memmove", memmove(a + 1, a, size));
+	stringbench("memset", memset(a, 0x5a, size));
+	stringbench("memcmp", stringbench_sink = memcmp(a, b, size));
+	stringbench("strlen", stringbench_sink = strlen((char *)a));
+	stringbench("strnlen", stringbench_sink = strnlen((char *)a, size));
+	stringbench("byte at a time memcpy",
+		    __nokasan_default_memcpy(a, b, size));
+	stringbench("byte at a time memset",
+		    __nokasan_default_memset(a, 0x5a, size));
+
+	ret = COMMAND_SUCCESS;
+out:
+	free(b);
+	free(a);
+
+	return ret;
+}
+
+BAREBOX_CMD_HELP_START(stringbench)
+BAREBOX_CMD_HELP_TEXT("Measure the throughput of the memory and string functions")
+BAREBOX_CMD_HELP_TEXT("and of the byte at a time memcpy() and memset() for comparison.")
+BAREBOX_CMD_HELP_TEXT("")
+BAREBOX_CMD_HELP_TEXT("Options:")
+BAREBOX_CMD_HELP_OPT("-s SIZE", "buffer size (default 1M)")
+BAREBOX_CMD_HELP_OPT("-l LOOPS", "calls per function (default 16)")
+BAREBOX_CMD_HELP_END
+
+BAREBOX_CMD_START(stringbench)
+	.cmd		= do_stringbench,
+	BAREBOX_CMD_DESC("benchmark the memory and string functions")
+	BAREBOX_CMD_OPTS("[-sl]")
+	BAREBOX_CMD_GROUP(CMD_GRP_INFO)
+	BAREBOX_CMD_HELP(cmd_stringbench_help)
+BAREBOX_CMD_END
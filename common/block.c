@@ -10,8 +10,14 @@
 #include <malloc.h>
 #include <linux/err.h>
 #include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/rbtree.h>
 #include <dma.h>
 #include <file-list.h>
+#include <globalvar.h>
+#include <magicvar.h>
+#include <init.h>
 
 LIST_HEAD(block_device_list);
 
@@ -21,69 +27,215 @@ struct chunk {
 	sector_t block_start; /* first block in this chunk */
 	int dirty; /* need to write back to device */
 	int num; /* number of chunk, debugging only */
-	struct list_head list;
+	int readahead; /* read ahead and not accessed yet */
+	struct list_head list; /* in buffered_blocks (LRU order) or idle_blocks */
+	struct hlist_node hnode; /* in chunk_hash while cached */
+	struct rb_node dirty_node; /* in dirty_chunks while dirty */
 };
 
 #define BUFSIZE (PAGE_SIZE * 16)
 
+/* maximum read-ahead window in chunks */
+#define BLOCK_READAHEAD_MAX_CHUNKS	8
+
+/* upper limit for the cache size, 64MiB */
+#define BLOCK_CACHE_MAX_CHUNKS		1024
+
+static int block_cache_chunks = 8;
+
 static int writebuffer_io_len(struct block_device *blk, struct chunk *chunk)
 {
 	return min_t(blkcnt_t, blk->rdbufsize, blk->num_blocks - chunk->block_start);
 }
 
 /*
- * Write all dirty chunks back to the device
+ * Dirty chunks are kept in a tree sorted by their position on the device
+ * so that they can be written back in order and adjacent chunks can be
+ * merged into a single write.
  */
-static int writebuffer_flush(struct block_device *blk)
+static void chunk_set_dirty(struct block_device *blk, struct chunk *chunk)
 {
-	struct chunk *chunk;
+	struct rb_node **p = &blk->dirty_chunks.rb_node, *parent = NULL;
+
+	if (chunk->dirty)
+		return;
+
+	while (*p) {
+		struct chunk *c = rb_entry(*p, struct chunk, dirty_node);
+
+		parent = *p;
+		if (chunk->block_start < c->block_start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&chunk->dirty_node, parent, p);
+	rb_insert_color(&chunk->dirty_node, &blk->dirty_chunks);
+	chunk->dirty = 1;
+}
+
+static void chunk_clear_dirty(struct block_device *blk, struct chunk *chunk)
+{
+	if (!chunk->dirty)
+		return;
+
+	rb_erase(&chunk->dirty_node, &blk->dirty_chunks);
+	chunk->dirty = 0;
+}
+
+#define for_each_dirty_chunk(blk, chunk) \
+	for (chunk = rb_entry_safe(rb_first(&(blk)->dirty_chunks), struct chunk, dirty_node); \
+	     chunk; \
+	     chunk = rb_entry_safe(rb_next(&chunk->dirty_node), struct chunk, dirty_node))
+
+/*
+ * Write back a run of nchunks adjacent dirty chunks starting with first.
+ * Runs of more than one chunk are merged in the bounce buffer and written
+ * with a single request.
+ */
+static int writebuffer_write_run(struct block_device *blk, struct chunk *first,
+				 unsigned int nchunks)
+{
+	struct chunk *chunk, *next;
+	blkcnt_t num = 0;
+	void *buf;
+	unsigned int i;
+	int ret;
+
+	if (nchunks == 1) {
+		buf = first->data;
+		num = writebuffer_io_len(blk, first);
+	} else {
+		buf = blk->bounce_buf;
+		chunk = first;
+		for (i = 0; i < nchunks; i++) {
+			memcpy(buf + (num << blk->blockbits), chunk->data,
+			       writebuffer_io_len(blk, chunk) << blk->blockbits);
+			num += writebuffer_io_len(blk, chunk);
+			chunk = rb_entry_safe(rb_next(&chunk->dirty_node),
+					      struct chunk, dirty_node);
+		}
+	}
+
+	dev_dbg(blk->dev, "%s: %llu, %u chunks\n", __func__, first->block_start,
+		nchunks);
+
+	ret = blk->ops->write(blk, buf, first->block_start, num);
+	if (ret < 0)
+		return ret;
+
+	chunk = first;
+	for (i = 0; i < nchunks; i++) {
+		next = rb_entry_safe(rb_next(&chunk->dirty_node),
+				     struct chunk, dirty_node);
+		chunk_clear_dirty(blk, chunk);
+		chunk = next;
+	}
+
+	return 0;
+}
+
+/*
+ * Write all dirty chunks back to the device in ascending order, merging
+ * adjacent chunks.
+ */
+static int writebuffer_writeback(struct block_device *blk)
+{
+	struct chunk *first, *chunk, *next;
+	unsigned int n;
 	int ret;
 
 	if (!IS_ENABLED(CONFIG_BLOCK_WRITE))
 		return 0;
 
-	list_for_each_entry(chunk, &blk->buffered_blocks, list) {
-		if (chunk->dirty) {
-			ret = blk->ops->write(blk, chunk->data,
-					      chunk->block_start,
-					      writebuffer_io_len(blk, chunk));
-			if (ret < 0)
-				return ret;
+	first = rb_entry_safe(rb_first(&blk->dirty_chunks), struct chunk, dirty_node);
+
+	while (first) {
+		chunk = first;
+		next = rb_entry_safe(rb_next(&chunk->dirty_node), struct chunk, dirty_node);
 
-			chunk->dirty = 0;
+		for (n = 1; n < blk->ra_max && next; n++) {
+			if (next->block_start != chunk->block_start + blk->rdbufsize)
+				break;
+			chunk = next;
+			next = rb_entry_safe(rb_next(&chunk->dirty_node),
+					     struct chunk, dirty_node);
 		}
+
+		ret = writebuffer_write_run(blk, first, n);
+		if (ret)
+			return ret;
+
+		first = next;
 	}
 
+	return 0;
+}
+
+/*
+ * Write all dirty chunks back to the device and flush the device
+ */
+static int writebuffer_flush(struct block_device *blk)
+{
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_BLOCK_WRITE))
+		return 0;
+
+	ret = writebuffer_writeback(blk);
+	if (ret)
+		return ret;
+
 	if (blk->ops->flush)
 		return blk->ops->flush(blk);
 
 	return 0;
 }
 
+static struct hlist_head *chunk_hash_head(struct block_device *blk,
+					  sector_t block_start)
+{
+	return &blk->chunk_hash[hash_64(block_start, blk->chunk_hash_bits)];
+}
+
 /*
- * get the chunk containing a given block. Will return NULL if the
- * block is not cached, the chunk otherwise.
+ * Look up the chunk starting at block_start without updating the LRU order.
  */
-static struct chunk *chunk_get_cached(struct block_device *blk, sector_t block)
+static struct chunk *chunk_find(struct block_device *blk, sector_t block_start)
 {
 	struct chunk *chunk;
 
-	list_for_each_entry(chunk, &blk->buffered_blocks, list) {
-		if (block >= chunk->block_start &&
-				block < chunk->block_start + blk->rdbufsize) {
-			dev_dbg(blk->dev, "%s: found %llu in %d\n", __func__,
-				block, chunk->num);
-			/*
-			 * move most recently used entry to the head of the list
-			 */
-			list_move(&chunk->list, &blk->buffered_blocks);
+	hlist_for_each_entry(chunk, chunk_hash_head(blk, block_start), hnode) {
+		if (chunk->block_start == block_start)
 			return chunk;
-		}
 	}
 
 	return NULL;
 }
 
+/*
+ * get the chunk containing a given block. Will return NULL if the
+ * block is not cached, the chunk otherwise.
+ */
+static struct chunk *chunk_get_cached(struct block_device *blk, sector_t block)
+{
+	struct chunk *chunk;
+
+	chunk = chunk_find(blk, block & ~blk->blkmask);
+	if (!chunk)
+		return NULL;
+
+	dev_dbg(blk->dev, "%s: found %llu in %d\n", __func__, block, chunk->num);
+
+	/*
+	 * move most recently used entry to the head of the list
+	 */
+	list_move(&chunk->list, &blk->buffered_blocks);
+
+	return chunk;
+}
+
 /*
  * Get the data pointer for a given block. Will return NULL if
  * the block is not cached, the data pointer otherwise.
@@ -96,13 +248,34 @@ static void *block_get_cached(struct block_device *blk, sector_t block)
 	if (!chunk)
 		return NULL;
 
+	if (chunk->readahead) {
+		chunk->readahead = 0;
+		blk->cache_readahead_hits++;
+	}
+
 	return chunk->data + (block - chunk->block_start) * BLOCKSIZE(blk);
 }
 
+/*
+ * Find the least recently used chunk which is not dirty
+ */
+static struct chunk *chunk_get_lru_clean(struct block_device *blk)
+{
+	struct chunk *chunk;
+
+	list_for_each_entry_reverse(chunk, &blk->buffered_blocks, list) {
+		if (!chunk->dirty)
+			return chunk;
+	}
+
+	return NULL;
+}
+
 /*
  * Get a data chunk, either from the idle list or if the idle list
- * is empty, the least recently used is written back to disk and
- * returned.
+ * is empty, the least recently used clean chunk is returned. When all
+ * chunks are dirty, they are written back to disk together and the
+ * least recently used one is returned.
  */
 static struct chunk *get_chunk(struct block_device *blk)
 {
@@ -110,17 +283,18 @@ static struct chunk *get_chunk(struct block_device *blk)
 	int ret;
 
 	if (list_empty(&blk->idle_blocks)) {
-		/* use last entry which is the most unused */
-		chunk = list_last_entry(&blk->buffered_blocks, struct chunk, list);
-		if (chunk->dirty) {
-			ret = blk->ops->write(blk, chunk->data,
-					      chunk->block_start,
-					      writebuffer_io_len(blk, chunk));
-			if (ret < 0)
+		chunk = chunk_get_lru_clean(blk);
+		if (!chunk) {
+			ret = writebuffer_writeback(blk);
+			if (ret)
 				return ERR_PTR(ret);
 
-			chunk->dirty = 0;
+			/* use last entry which is the most unused */
+			chunk = list_last_entry(&blk->buffered_blocks,
+						struct chunk, list);
 		}
+		hlist_del_init(&chunk->hnode);
+		blk->cache_evictions++;
 	} else {
 		chunk = list_first_entry(&blk->idle_blocks, struct chunk, list);
 	}
@@ -130,6 +304,90 @@ static struct chunk *get_chunk(struct block_device *blk)
 	return chunk;
 }
 
+/*
+ * Determine how many chunks to read on a cache miss at block_start.
+ * The read-ahead window doubles with every miss that continues where
+ * the previous one stopped and collapses to a single chunk on random
+ * access. Read-ahead stops at the first chunk that is already cached.
+ */
+static unsigned int block_readahead_window(struct block_device *blk,
+					   sector_t block_start)
+{
+	unsigned int n;
+
+	if (block_start == blk->ra_next)
+		blk->ra_window = min(blk->ra_window * 2, blk->ra_max);
+	else
+		blk->ra_window = 1;
+
+	for (n = 1; n < blk->ra_window; n++) {
+		sector_t next = block_start + n * blk->rdbufsize;
+
+		if (next >= blk->num_blocks || chunk_find(blk, next))
+			break;
+	}
+
+	blk->ra_next = block_start + n * blk->rdbufsize;
+
+	return n;
+}
+
+/*
+ * Read nchunks consecutive chunks starting at block_start with a single
+ * request to the device and distribute the data to cache chunks.
+ */
+static int block_cache_readahead(struct block_device *blk, sector_t block_start,
+				 unsigned int nchunks)
+{
+	blkcnt_t num = min_t(blkcnt_t, (blkcnt_t)nchunks * blk->rdbufsize,
+			     blk->num_blocks - block_start);
+	struct chunk *chunks[BLOCK_READAHEAD_MAX_CHUNKS];
+	unsigned int i;
+	int ret;
+
+	dev_dbg(blk->dev, "%s: %llu, %u chunks\n", __func__, block_start, nchunks);
+
+	/*
+	 * Get all chunks before reading into the bounce buffer: getting a
+	 * chunk may write back dirty chunks, which uses the bounce buffer
+	 * as well.
+	 */
+	for (i = 0; i < nchunks; i++) {
+		chunks[i] = get_chunk(blk);
+		if (IS_ERR(chunks[i])) {
+			ret = PTR_ERR(chunks[i]);
+			goto err;
+		}
+	}
+
+	ret = blk->ops->read(blk, blk->bounce_buf, block_start, num);
+	if (ret)
+		goto err;
+
+	for (i = 0; i < nchunks; i++) {
+		struct chunk *chunk = chunks[i];
+
+		chunk->block_start = block_start + i * blk->rdbufsize;
+		chunk->readahead = i > 0;
+		memcpy(chunk->data,
+		       blk->bounce_buf + ((i * blk->rdbufsize) << blk->blockbits),
+		       writebuffer_io_len(blk, chunk) << blk->blockbits);
+
+		list_add(&chunk->list, &blk->buffered_blocks);
+		hlist_add_head(&chunk->hnode, chunk_hash_head(blk, chunk->block_start));
+	}
+
+	blk->cache_readahead += nchunks - 1;
+
+	return 0;
+
+err:
+	while (i--)
+		list_add_tail(&chunks[i]->list, &blk->idle_blocks);
+
+	return ret;
+}
+
 /*
  * read a block into the cache. This assumes that the block is
  * not cached already. By definition block_get_cached() for
@@ -137,14 +395,23 @@ static struct chunk *get_chunk(struct block_device *blk)
  */
 static int block_cache(struct block_device *blk, sector_t block)
 {
+	sector_t block_start = block & ~blk->blkmask;
 	struct chunk *chunk;
+	unsigned int nchunks;
 	int ret;
 
+	if (!blk->discard_size) {
+		nchunks = block_readahead_window(blk, block_start);
+		if (nchunks > 1)
+			return block_cache_readahead(blk, block_start, nchunks);
+	}
+
 	chunk = get_chunk(blk);
 	if (IS_ERR(chunk))
 		return PTR_ERR(chunk);
 
-	chunk->block_start = block & ~blk->blkmask;
+	chunk->block_start = block_start;
+	chunk->readahead = 0;
 
 	dev_dbg(blk->dev, "%s: %llu to %d\n", __func__, chunk->block_start,
 		chunk->num);
@@ -153,8 +420,7 @@ static int block_cache(struct block_device *blk, sector_t block)
 	    chunk->block_start * BLOCKSIZE(blk) + writebuffer_io_len(blk, chunk)
 	    <= blk->discard_start + blk->discard_size) {
 		memset(chunk->data, 0, writebuffer_io_len(blk, chunk));
-		list_add(&chunk->list, &blk->buffered_blocks);
-		return 0;
+		goto out;
 	}
 
 	ret = blk->ops->read(blk, chunk->data, chunk->block_start,
@@ -163,7 +429,9 @@ static int block_cache(struct block_device *blk, sector_t block)
 		list_add_tail(&chunk->list, &blk->idle_blocks);
 		return ret;
 	}
+out:
 	list_add(&chunk->list, &blk->buffered_blocks);
+	hlist_add_head(&chunk->hnode, chunk_hash_head(blk, chunk->block_start));
 
 	return 0;
 }
@@ -181,8 +449,12 @@ static void *block_get(struct block_device *blk, sector_t block)
 		return ERR_PTR(-ENXIO);
 
 	outdata = block_get_cached(blk, block);
-	if (outdata)
+	if (outdata) {
+		blk->cache_hits++;
 		return outdata;
+	}
+
+	blk->cache_misses++;
 
 	ret = block_cache(blk, block);
 	if (ret)
@@ -195,6 +467,60 @@ static void *block_get(struct block_device *blk, sector_t block)
 	return outdata;
 }
 
+/*
+ * Large transfers of whole blocks bypass the cache and go directly to
+ * the device in a single request. The buffer is handed to the driver, so
+ * it must be suitable for DMA.
+ */
+static bool block_direct_io_possible(struct block_device *blk, const void *buf,
+				     sector_t block, blkcnt_t blocks)
+{
+	return blocks >= blk->rdbufsize &&
+		IS_ALIGNED((unsigned long)buf, DMA_ALIGNMENT) &&
+		block + blocks <= blk->num_blocks;
+}
+
+/*
+ * Calculate the overlap of a cached chunk with the block range
+ * [block, block + blocks). Returns false if there is no overlap.
+ */
+static bool chunk_overlap(struct block_device *blk, struct chunk *chunk,
+			  sector_t block, blkcnt_t blocks,
+			  sector_t *start, sector_t *end)
+{
+	*start = max_t(sector_t, block, chunk->block_start);
+	*end = min_t(sector_t, block + blocks,
+		     chunk->block_start + writebuffer_io_len(blk, chunk));
+
+	return *start < *end;
+}
+
+static int block_direct_read(struct block_device *blk, void *buf,
+			     sector_t block, blkcnt_t blocks)
+{
+	struct chunk *chunk;
+	sector_t start, end;
+	int ret;
+
+	ret = blk->ops->read(blk, buf, block, blocks);
+	if (ret)
+		return ret;
+
+	/* dirty chunks are newer than the data on the device */
+	for_each_dirty_chunk(blk, chunk) {
+		if (chunk->block_start >= block + blocks)
+			break;
+		if (!chunk_overlap(blk, chunk, block, blocks, &start, &end))
+			continue;
+
+		memcpy(buf + ((start - block) << blk->blockbits),
+		       chunk->data + ((start - chunk->block_start) << blk->blockbits),
+		       (end - start) << blk->blockbits);
+	}
+
+	return 0;
+}
+
 static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 		loff_t offset, unsigned long flags)
 {
@@ -203,6 +529,7 @@ static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 	sector_t block = offset >> blk->blockbits;
 	size_t icount = count;
 	blkcnt_t blocks;
+	int ret;
 
 	if (offset & mask) {
 		size_t now = BLOCKSIZE(blk) - (offset & mask);
@@ -221,6 +548,17 @@ static ssize_t block_op_read(struct cdev *cdev, void *buf, size_t count,
 
 	blocks = count >> blk->blockbits;
 
+	if (block_direct_io_possible(blk, buf, block, blocks)) {
+		ret = block_direct_read(blk, buf, block, blocks);
+		if (ret)
+			return ret;
+
+		buf += blocks << blk->blockbits;
+		count -= blocks << blk->blockbits;
+		block += blocks;
+		blocks = 0;
+	}
+
 	while (blocks) {
 		void *iobuf = block_get(blk, block);
 
@@ -267,7 +605,44 @@ static int block_put(struct block_device *blk, const void *buf, sector_t block)
 	memcpy(data, buf, 1 << blk->blockbits);
 
 	chunk = chunk_get_cached(blk, block);
-	chunk->dirty = 1;
+	chunk_set_dirty(blk, chunk);
+
+	return 0;
+}
+
+static int block_direct_write(struct block_device *blk, const void *buf,
+			      sector_t block, blkcnt_t blocks)
+{
+	struct chunk *chunk, *tmp;
+	sector_t start, end;
+	int ret;
+
+	ret = blk->ops->write(blk, buf, block, blocks);
+	if (ret)
+		return ret;
+
+	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list) {
+		if (!chunk_overlap(blk, chunk, block, blocks, &start, &end))
+			continue;
+
+		if (start == chunk->block_start &&
+		    end == chunk->block_start + writebuffer_io_len(blk, chunk)) {
+			/* completely overwritten, drop it from the cache */
+			chunk_clear_dirty(blk, chunk);
+			hlist_del_init(&chunk->hnode);
+			list_move_tail(&chunk->list, &blk->idle_blocks);
+			continue;
+		}
+
+		/*
+		 * Partially overwritten, update the cached data. The chunk
+		 * keeps its dirty state, if it is written back later it
+		 * writes the same data again.
+		 */
+		memcpy(chunk->data + ((start - chunk->block_start) << blk->blockbits),
+		       buf + ((start - block) << blk->blockbits),
+		       (end - start) << blk->blockbits);
+	}
 
 	return 0;
 }
@@ -314,6 +689,17 @@ static ssize_t block_op_write(struct cdev *cdev, const void *buf, size_t count,
 
 	blocks = count >> blk->blockbits;
 
+	if (block_direct_io_possible(blk, buf, block, blocks)) {
+		ret = block_direct_write(blk, buf, block, blocks);
+		if (ret)
+			return ret;
+
+		buf += blocks << blk->blockbits;
+		count -= blocks << blk->blockbits;
+		block += blocks;
+		blocks = 0;
+	}
+
 	while (blocks) {
 		ret = block_put(blk, buf, block);
 		if (ret)
@@ -392,11 +778,187 @@ struct block_device *cdev_get_block_device(const struct cdev *cdev)
 	return cdev->priv;
 }
 
+static void block_cache_free(struct block_device *blk)
+{
+	struct chunk *chunk, *tmp;
+
+	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list) {
+		dma_free(chunk->data);
+		free(chunk);
+	}
+
+	list_for_each_entry_safe(chunk, tmp, &blk->idle_blocks, list) {
+		dma_free(chunk->data);
+		free(chunk);
+	}
+
+	INIT_LIST_HEAD(&blk->buffered_blocks);
+	INIT_LIST_HEAD(&blk->idle_blocks);
+	blk->dirty_chunks = RB_ROOT;
+
+	free(blk->chunk_hash);
+	blk->chunk_hash = NULL;
+
+	dma_free(blk->bounce_buf);
+	blk->bounce_buf = NULL;
+}
+
+/*
+ * (Re)allocate the cache with blk->cache_chunks chunks, which is limited
+ * to BLOCK_CACHE_MAX_CHUNKS. Dirty data must have been written back before
+ * calling this. The new cache is allocated completely before the old one
+ * is freed, so the old one stays in place if that fails.
+ */
+static int block_cache_alloc(struct block_device *blk)
+{
+	struct chunk *chunk, *tmp;
+	struct hlist_head *chunk_hash;
+	void *bounce_buf = NULL;
+	unsigned int nbuckets, ra_max;
+	LIST_HEAD(chunks);
+	int i;
+
+	if (!blk->cache_chunks)
+		return -EINVAL;
+
+	blk->cache_chunks = min_t(u32, blk->cache_chunks, BLOCK_CACHE_MAX_CHUNKS);
+
+	/* at least two buckets, hash_64() can't handle 0 bits */
+	nbuckets = roundup_pow_of_two(max(blk->cache_chunks, 2U));
+	chunk_hash = calloc(nbuckets, sizeof(*chunk_hash));
+	if (!chunk_hash)
+		return -ENOMEM;
+
+	for (i = 0; i < blk->cache_chunks; i++) {
+		chunk = calloc(1, sizeof(*chunk));
+		if (!chunk)
+			goto err;
+
+		chunk->data = dma_alloc(BUFSIZE);
+		if (!chunk->data) {
+			free(chunk);
+			goto err;
+		}
+
+		chunk->num = i;
+		INIT_HLIST_NODE(&chunk->hnode);
+		list_add_tail(&chunk->list, &chunks);
+	}
+
+	/*
+	 * Limit the read-ahead window to half of the cache so that
+	 * read-ahead doesn't evict everything else. The bounce buffer is
+	 * also used to merge adjacent dirty chunks on write back.
+	 */
+	ra_max = clamp_t(unsigned int, blk->cache_chunks / 2, 1,
+			 BLOCK_READAHEAD_MAX_CHUNKS);
+	if (ra_max > 1) {
+		bounce_buf = dma_alloc(ra_max * BUFSIZE);
+		if (!bounce_buf)
+			goto err;
+	}
+
+	block_cache_free(blk);
+
+	list_splice(&chunks, &blk->idle_blocks);
+	blk->chunk_hash = chunk_hash;
+	blk->chunk_hash_bits = ilog2(nbuckets);
+	blk->bounce_buf = bounce_buf;
+	blk->ra_max = ra_max;
+	blk->ra_window = 1;
+	blk->ra_next = 0;
+
+	return 0;
+
+err:
+	list_for_each_entry_safe(chunk, tmp, &chunks, list) {
+		dma_free(chunk->data);
+		free(chunk);
+	}
+	free(chunk_hash);
+
+	return -ENOMEM;
+}
+
+static int block_cache_set_chunks(struct param_d *p, void *priv)
+{
+	struct block_device *blk = priv;
+	int ret;
+
+	if (!blk->cache_chunks)
+		return -EINVAL;
+
+	ret = writebuffer_flush(blk);
+	if (ret)
+		return ret;
+
+	return block_cache_alloc(blk);
+}
+
+/*
+ * The parameters end up on blk->dev which may be shared between multiple
+ * block devices (e.g. the boot and user areas of an eMMC), so prefix them
+ * with the part of the cdev name that distinguishes them.
+ */
+static struct param_d *block_add_cache_param(struct block_device *blk,
+					     const char *name, u32 *value,
+					     bool writable)
+{
+	const char *devname = dev_name(blk->dev);
+	const char *cdevname = blk->cdev.name;
+	size_t len = strlen(devname);
+	struct param_d *p;
+	char *pname;
+
+	if (!strcmp(cdevname, devname))
+		pname = xstrdup(name);
+	else if (!strncmp(cdevname, devname, len) && cdevname[len] == '.')
+		pname = xasprintf("%s_%s", cdevname + len + 1, name);
+	else
+		pname = xasprintf("%s_%s", cdevname, name);
+
+	if (writable)
+		p = dev_add_param_uint32(blk->dev, pname, block_cache_set_chunks,
+					 NULL, value, "%u", blk);
+	else
+		p = dev_add_param_uint32_ro(blk->dev, pname, value, "%u");
+
+	free(pname);
+
+	return p;
+}
+
+static void block_add_cache_params(struct block_device *blk)
+{
+	blk->cache_params[0] = block_add_cache_param(blk, "cache_chunks",
+						     &blk->cache_chunks, true);
+	blk->cache_params[1] = block_add_cache_param(blk, "cache_hits",
+						     &blk->cache_hits, false);
+	blk->cache_params[2] = block_add_cache_param(blk, "cache_misses",
+						     &blk->cache_misses, false);
+	blk->cache_params[3] = block_add_cache_param(blk, "cache_evictions",
+						     &blk->cache_evictions, false);
+	blk->cache_params[4] = block_add_cache_param(blk, "cache_readahead",
+						     &blk->cache_readahead, false);
+	blk->cache_params[5] = block_add_cache_param(blk, "cache_readahead_hits",
+						     &blk->cache_readahead_hits, false);
+}
+
+static void block_remove_cache_params(struct block_device *blk)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(blk->cache_params); i++) {
+		if (!IS_ERR_OR_NULL(blk->cache_params[i]))
+			dev_remove_param(blk->cache_params[i]);
+		blk->cache_params[i] = NULL;
+	}
+}
+
 int blockdevice_register(struct block_device *blk)
 {
 	loff_t size = (loff_t)blk->num_blocks * BLOCKSIZE(blk);
 	int ret;
-	int i;
 
 	blk->cdev.size = size;
 	blk->cdev.dev = blk->dev;
@@ -416,19 +978,23 @@ int blockdevice_register(struct block_device *blk)
 		return -ENOSYS;
 	}
 
-	for (i = 0; i < 8; i++) {
-		struct chunk *chunk = xzalloc(sizeof(*chunk));
-		chunk->data = dma_alloc(BUFSIZE);
-		chunk->num = i;
-		list_add_tail(&chunk->list, &blk->idle_blocks);
-	}
+	if (!blk->cache_chunks)
+		blk->cache_chunks = max(block_cache_chunks, 1);
 
-	ret = devfs_create(&blk->cdev);
+	ret = block_cache_alloc(blk);
 	if (ret)
 		return ret;
 
+	ret = devfs_create(&blk->cdev);
+	if (ret) {
+		block_cache_free(blk);
+		return ret;
+	}
+
 	list_add_tail(&blk->list, &block_device_list);
 
+	block_add_cache_params(blk);
+
 	cdev_create_default_automount(&blk->cdev);
 
 	/* Lack of partition table is unusual, but not a failure */
@@ -439,19 +1005,10 @@ int blockdevice_register(struct block_device *blk)
 
 int blockdevice_unregister(struct block_device *blk)
 {
-	struct chunk *chunk, *tmp;
-
 	writebuffer_flush(blk);
 
-	list_for_each_entry_safe(chunk, tmp, &blk->buffered_blocks, list) {
-		dma_free(chunk->data);
-		free(chunk);
-	}
-
-	list_for_each_entry_safe(chunk, tmp, &blk->idle_blocks, list) {
-		dma_free(chunk->data);
-		free(chunk);
-	}
+	block_remove_cache_params(blk);
+	block_cache_free(blk);
 
 	devfs_remove(&blk->cdev);
 	list_del(&blk->list);
@@ -481,6 +1038,16 @@ int block_write(struct block_device *blk, void *buf, sector_t block, blkcnt_t nu
 	return ret < 0 ? ret : 0;
 }
 
+static int block_cache_init(void)
+{
+	return globalvar_add_simple_int("blockdevice.cache_chunks",
+					&block_cache_chunks, "%u");
+}
+core_initcall(block_cache_init);
+
+BAREBOX_MAGICVAR(global.blockdevice.cache_chunks,
+		 "Number of 64KiB cache chunks for newly registered block devices (max. 1024)");
+
 unsigned file_list_add_blockdevs(struct file_list *files)
 {
 	struct block_device *blk;
@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * boot-profile.c - record where the boot time goes
+ *
+ * Every initcall, every device probe and every round of the deferred probe
+ * loop is recorded as an event with its start time and duration. Events
+ * nest: probes triggered by an initcall are recorded inside of it, probes
+ * of a parent device from within a probe function inside of that.
+ * Recording stops once the initcalls are done, later probes are not part of
+ * the boot time and would only accumulate events for as long as we run.
+ */
+
+#include <common.h>
+#include <boot-profile.h>
+#include <clock.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fs.h>
+#include <kallsyms.h>
+#include <malloc.h>
+#include <qsort.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+
+struct boot_profile_event {
+	struct list_head list;
+	enum boot_profile_type type;
+	const char *name;
+	const void *fn;
+	u64 start;
+	u64 duration;
+	int depth;
+	bool nested;	/* inside of another event of the same type */
+	int ret;
+};
+
+struct boot_profile_sum {
+	enum boot_profile_type type;
+	const char *name;
+	const void *fn;
+	unsigned int count;
+	unsigned int deferrals;
+	u64 duration;
+};
+
+static LIST_HEAD(boot_profile_events);
+static unsigned int boot_profile_num_events;
+static int boot_profile_depth;
+static bool boot_profile_stopped;
+static int boot_profile_open[BOOT_PROFILE_DEFERRED + 1];
+
+static const char * const boot_profile_type_names[] = {
+	[BOOT_PROFILE_INITCALL] = "initcall",
+	[BOOT_PROFILE_PROBE] = "probe",
+	[BOOT_PROFILE_DEFERRED] = "deferred",
+};
+
+/**
+ * boot_profile_start - start recording an event
+ * @type: what is recorded
+ * @name: name of the event, copied. May be NULL if @fn is given
+ * @fn: function called, used as name if @name is NULL
+ *
+ * Return: the event to pass to boot_profile_end(), NULL if recording has
+ * been stopped
+ */
+struct boot_profile_event *boot_profile_start(enum boot_profile_type type,
+					      const char *name, const void *fn)
+{
+	struct boot_profile_event *ev;
+
+	if (boot_profile_stopped)
+		return NULL;
+
+	ev = xzalloc(sizeof(*ev));
+	ev->type = type;
+	ev->name = name ? xstrdup(name) : NULL;
+	ev->fn = fn;
+	ev->depth = boot_profile_depth++;
+	ev->nested = boot_profile_open[type]++ > 0;
+
+	list_add_tail(&ev->list, &boot_profile_events);
+	boot_profile_num_events++;
+
+	ev->start = get_time_ns();
+
+	return ev;
+}
+
+/**
+ * boot_profile_end - finish recording an event
+ * @ev: the event returned from boot_profile_start(), may be NULL
+ * @ret: the result of the recorded operation
+ */
+void boot_profile_end(struct boot_profile_event *ev, int ret)
+{
+	if (!ev)
+		return;
+
+	ev->duration = get_time_ns() - ev->start;
+	ev->ret = ret;
+
+	boot_profile_depth--;
+	boot_profile_open[ev->type]--;
+}
+
+/**
+ * boot_profile_stop - stop recording events
+ *
+ * Called when the initcalls are done. Events still open are finished as
+ * usual, no new events are recorded.
+ */
+void boot_profile_stop(void)
+{
+	boot_profile_stopped = true;
+}
+
+static const char *boot_profile_name(const char *name, const void *fn,
+				     char *buf, size_t len)
+{
+	if (name)
+		return name;
+
+	snprintf(buf, len, "%pS", fn);
+
+	return buf;
+}
+
+static void boot_profile_print_time(u64 ns)
+{
+	u32 us;
+	u64 ms = div_u64_rem(div_u64(ns, NSEC_PER_USEC), 1000, &us);
+
+	printf("%7llu.%03u", ms, us);
+}
+
+static int boot_profile_compare_events(const void *a, const void *b)
+{
+	const struct boot_profile_event *ea = *(struct boot_profile_event **)a;
+	const struct boot_profile_event *eb = *(struct boot_profile_event **)b;
+
+	if (ea->duration == eb->duration)
+		return 0;
+
+	return ea->duration < eb->duration ? 1 : -1;
+}
+
+static int boot_profile_compare_sums(const void *a, const void *b)
+{
+	const struct boot_profile_sum *sa = a, *sb = b;
+
+	if (sa->duration == sb->duration)
+		return 0;
+
+	return sa->duration < sb->duration ? 1 : -1;
+}
+
+static void boot_profile_print_events(unsigned flags, u64 min_ns)
+{
+	struct boot_profile_event *ev, **events;
+	char buf[KSYM_NAME_LEN];
+	unsigned int i = 0;
+
+	events = xmalloc(boot_profile_num_events * sizeof(*events));
+
+	list_for_each_entry(ev, &boot_profile_events, list)
+		events[i++] = ev;
+
+	if (flags & BOOT_PROFILE_SORT)
+		qsort(events, i, sizeof(*events), boot_profile_compare_events);
+
+	printf("   start [ms]    time [ms]  type      result  name\n");
+
+	for (i = 0; i < boot_profile_num_events; i++) {
+		ev = events[i];
+
+		if (ev->duration < min_ns)
+			continue;
+
+		boot_profile_print_time(ev->start);
+		printf("  ");
+		boot_profile_print_time(ev->duration);
+		printf("  %-8s  %6d  %*s%s\n", boot_profile_type_names[ev->type],
+		       ev->ret, flags & BOOT_PROFILE_SORT ? 0 : ev->depth * 2, "",
+		       boot_profile_name(ev->name, ev->fn, buf, sizeof(buf)));
+	}
+
+	free(events);
+}
+
+static void boot_profile_print_summary(unsigned flags, u64 min_ns)
+{
+	struct boot_profile_sum *sums, *sum;
+	struct boot_profile_event *ev;
+	char buf[KSYM_NAME_LEN];
+	unsigned int i, num = 0;
+
+	sums = xzalloc(boot_profile_num_events * sizeof(*sums));
+
+	list_for_each_entry(ev, &boot_profile_events, list) {
+		for (i = 0; i < num; i++) {
+			sum = &sums[i];
+			if (sum->type == ev->type && sum->fn == ev->fn &&
+			    !strcmp(sum->name ?: "", ev->name ?: ""))
+				break;
+		}
+
+		sum = &sums[i];
+		if (i == num) {
+			sum->type = ev->type;
+			sum->name = ev->name;
+			sum->fn = ev->fn;
+			num++;
+		}
+
+		sum->count++;
+		sum->duration += ev->duration;
+		if (ev->ret == -EPROBE_DEFER)
+			sum->deferrals++;
+	}
+
+	if (flags & BOOT_PROFILE_SORT)
+		qsort(sums, num, sizeof(*sums), boot_profile_compare_sums);
+
+	printf("    time [ms]  type      calls  deferred  name\n");
+
+	for (i = 0; i < num; i++) {
+		sum = &sums[i];
+
+		if (sum->duration < min_ns)
+			continue;
+
+		boot_profile_print_time(sum->duration);
+		printf("  %-8s  %5u  %8u  %s\n", boot_profile_type_names[sum->type],
+		       sum->count, sum->deferrals,
+		       boot_profile_name(sum->name, sum->fn, buf, sizeof(buf)));
+	}
+
+	free(sums);
+}
+
+static void boot_profile_print_totals(void)
+{
+	u64 duration[ARRAY_SIZE(boot_profile_type_names)] = {};
+	unsigned int count[ARRAY_SIZE(boot_profile_type_names)] = {};
+	unsigned int deferrals = 0;
+	struct boot_profile_event *ev;
+	int i;
+
+	list_for_each_entry(ev, &boot_profile_events, list) {
+		count[ev->type]++;
+		if (ev->ret == -EPROBE_DEFER)
+			deferrals++;
+		if (!ev->nested)
+			duration[ev->type] += ev->duration;
+	}
+
+	printf("\n");
+
+	for (i = 0; i < ARRAY_SIZE(boot_profile_type_names); i++) {
+		boot_profile_print_time(duration[i]);
+		printf(" ms in %u %s events", count[i], boot_profile_type_names[i]);
+		if (i == BOOT_PROFILE_PROBE)
+			printf(", %u deferred", deferrals);
+		printf("\n");
+	}
+}
+
+/**
+ * boot_profile_print - print the recorded events
+ * @flags: BOOT_PROFILE_SUMMARY to sum up events by name, BOOT_PROFILE_SORT
+ *         to print the longest events first
+ * @min_ns: skip events shorter than this
+ */
+void boot_profile_print(unsigned flags, u64 min_ns)
+{
+	if (flags & BOOT_PROFILE_SUMMARY)
+		boot_profile_print_summary(flags, min_ns);
+	else
+		boot_profile_print_events(flags, min_ns);
+
+	boot_profile_print_totals();
+}
+
+/* escape a name for use in a JSON string */
+static const char *boot_profile_json_escape(const char *name, char *buf, size_t len)
+{
+	char *p = buf;
+
+	for (; *name && p < buf + len - 2; name++) {
+		if (*name == '"' || *name == '\\')
+			*p++ = '\\';
+		else if ((unsigned char)*name < 0x20)
+			continue;
+		*p++ = *name;
+	}
+
+	*p = 0;
+
+	return buf;
+}
+
+/**
+ * boot_profile_write_trace - write the recorded events to a file
+ * @filename: the file to write
+ *
+ * The file is written in the Trace Event Format understood by
+ * chrome://tracing and Perfetto.
+ *
+ * Return: 0 for success or a negative error code
+ */
+int boot_profile_write_trace(const char *filename)
+{
+	struct boot_profile_event *ev;
+	char name[KSYM_NAME_LEN], buf[2 * KSYM_NAME_LEN];
+	const char *sep = "";
+	int fd, ret;
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+	if (fd < 0)
+		return fd;
+
+	ret = dprintf(fd, "{\"traceEvents\":[\n");
+
+	list_for_each_entry(ev, &boot_profile_events, list) {
+		if (ret < 0)
+			break;
+
+		boot_profile_name(ev->name, ev->fn, name, sizeof(name));
+
+		ret = dprintf(fd, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+			      "\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":1,"
+			      "\"args\":{\"ret\":%d}}",
+			      sep, boot_profile_json_escape(name, buf, sizeof(buf)),
+			      boot_profile_type_names[ev->type],
+			      div_u64(ev->start, NSEC_PER_USEC),
+			      div_u64(ev->duration, NSEC_PER_USEC), ev->ret);
+		sep = ",\n";
+	}
+
+	if (ret >= 0)
+		ret = dprintf(fd, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	close(fd);
+
+	return ret < 0 ? ret : 0;
+}
@@ -39,6 +39,7 @@
 #include <restart.h>
 #include <console_countdown.h>
 #include <image-sparse.h>
+#include <bthread.h>
 #include <linux/types.h>
 #include <linux/stat.h>
 #include <linux/mtd/mtd.h>
@@ -49,6 +50,8 @@
 
 static unsigned int fastboot_max_download_size;
 static int fastboot_bbu;
+static int fastboot_download_buffer;
+static char *fastboot_stream_partition;
 static char *fastboot_partitions;
 
 struct fb_variable {
@@ -179,6 +182,8 @@ int fastboot_generic_init(struct fastboot *fb, bool export_bbu)
 	if (!fb->tempname)
 		return -ENOMEM;
 
+	fb->download_file = fb->tempname;
+
 	if (!fb->files)
 		fb->files = file_list_new();
 	if (export_bbu)
@@ -199,10 +204,373 @@ static void fastboot_free_variables(struct list_head *list)
 	}
 }
 
+static ssize_t fastboot_buffer_read(struct cdev *cdev, void *buf, size_t count,
+				    loff_t offset, ulong flags)
+{
+	struct fastboot *fb = cdev->priv;
+
+	if (offset >= cdev->size)
+		return 0;
+
+	count = min_t(loff_t, count, cdev->size - offset);
+	memcpy(buf, fb->download_buf + offset, count);
+
+	return count;
+}
+
+static int fastboot_buffer_memmap(struct cdev *cdev, void **map, int flags)
+{
+	struct fastboot *fb = cdev->priv;
+
+	if (flags & PROT_WRITE)
+		return -EACCES;
+
+	*map = fb->download_buf;
+
+	return 0;
+}
+
+static struct cdev_operations fastboot_buffer_ops = {
+	.read = fastboot_buffer_read,
+	.memmap = fastboot_buffer_memmap,
+};
+
+static void fastboot_release_buffer(struct fastboot *fb)
+{
+	if (!fb->download_buf)
+		return;
+
+	devfs_remove(&fb->download_cdev);
+	free(fb->download_cdev.name);
+	free(fb->download_file);
+	free(fb->download_buf);
+
+	fb->download_buf = NULL;
+	fb->download_file = fb->tempname;
+}
+
+/*
+ * Allocate a contiguous buffer for the download and export it as a
+ * character device, so that the downloaded data doesn't have to be
+ * copied through a ramfs file.
+ */
+static int fastboot_alloc_buffer(struct fastboot *fb)
+{
+	static int fastboot_buffer_id;
+	struct cdev *cdev = &fb->download_cdev;
+	int ret;
+
+	fb->download_buf = malloc(fb->download_size);
+	if (!fb->download_buf)
+		return -ENOMEM;
+
+	memset(cdev, 0, sizeof(*cdev));
+	cdev->name = basprintf("fastboot-download%d", fastboot_buffer_id++);
+	cdev->size = fb->download_size;
+	cdev->ops = &fastboot_buffer_ops;
+	cdev->priv = fb;
+
+	ret = devfs_create(cdev);
+	if (ret) {
+		free(cdev->name);
+		free(fb->download_buf);
+		fb->download_buf = NULL;
+		return ret;
+	}
+
+	fb->download_file = basprintf("/dev/%s", cdev->name);
+
+	return 0;
+}
+
+#define FASTBOOT_STREAM_BUF_SIZE	SZ_128K
+#define FASTBOOT_STREAM_MAX_BUFS	32
+
+struct fastboot_stream_buf {
+	struct list_head list;
+	size_t len;
+	size_t consumed;
+	u8 data[FASTBOOT_STREAM_BUF_SIZE];
+};
+
+/*
+ * State for writing a download to its target while it is received. The
+ * receive path queues the data in a list of buffers, a barebox thread
+ * takes them off the list and writes them to the target, either directly
+ * or through the sparse image parser.
+ */
+struct fastboot_stream {
+	struct file_list_entry *fentry;
+	struct sparse_image_stream *sparse;
+	struct bthread *thread;
+	struct list_head bufs;
+	unsigned int nbufs;
+	size_t received;
+	loff_t end;
+	int fd;
+	int ret;
+	bool is_reg;
+	bool done;
+	bool abort;
+	bool detached;
+};
+
+static inline bool fastboot_streaming(struct fastboot *fb)
+{
+	return IS_ENABLED(CONFIG_FASTBOOT_SPARSE_STREAM) && fb->stream;
+}
+
+static int fastboot_stream_write(void *priv, loff_t pos, const void *buf,
+				 size_t len)
+{
+	struct fastboot_stream *st = priv;
+	int ret;
+
+	discard_range(st->fd, len, pos);
+
+	if (lseek(st->fd, pos, SEEK_SET) == -1)
+		return errno == EINVAL ? -ENOSPC : -errno;
+
+	ret = write_full(st->fd, buf, len);
+	if (ret < 0)
+		return ret;
+
+	st->end = max_t(loff_t, st->end, pos + len);
+
+	return 0;
+}
+
+static int fastboot_stream_feed(struct fastboot_stream *st, const void *buf,
+				size_t len)
+{
+	if (st->sparse)
+		return sparse_image_stream_feed(st->sparse, buf, len);
+
+	return fastboot_stream_write(st, st->end, buf, len);
+}
+
+static void fastboot_stream_free(struct fastboot_stream *st)
+{
+	struct fastboot_stream_buf *sb, *tmp;
+
+	list_for_each_entry_safe(sb, tmp, &st->bufs, list)
+		free(sb);
+
+	sparse_image_stream_free(st->sparse);
+	close(st->fd);
+	free(st);
+}
+
+static void fastboot_stream_thread(void *data)
+{
+	struct fastboot_stream *st = data;
+
+	while (!st->abort) {
+		struct fastboot_stream_buf *sb;
+		size_t now;
+
+		sb = list_first_entry_or_null(&st->bufs,
+					      struct fastboot_stream_buf, list);
+		now = sb ? sb->len - sb->consumed : 0;
+
+		if (!now) {
+			if (st->done)
+				break;
+			bthread_reschedule();
+			continue;
+		}
+
+		/* after an error keep draining until the download has ended */
+		if (!st->ret)
+			st->ret = fastboot_stream_feed(st, sb->data + sb->consumed,
+						       now);
+
+		sb->consumed += now;
+		if (sb->consumed == FASTBOOT_STREAM_BUF_SIZE) {
+			list_del(&sb->list);
+			st->nbufs--;
+			free(sb);
+		}
+	}
+
+	if (st->detached)
+		fastboot_stream_free(st);
+}
+
+static int fastboot_stream_start(struct fastboot *fb)
+{
+	struct fastboot_stream *st;
+	struct file_list_entry *fentry;
+	unsigned int flags = O_RDWR;
+	struct stat s;
+	int ret;
+
+	fentry = file_list_entry_by_name(fb->files, fastboot_stream_partition);
+	if (!fentry)
+		return -ENOENT;
+
+	/* UBI volumes and barebox update handlers need the complete image */
+	if (fentry->flags & FILE_LIST_FLAG_UBI ||
+	    strstarts(fentry->name, "bbu-"))
+		return -EOPNOTSUPP;
+
+	ret = stat(fentry->filename, &s);
+	if (ret) {
+		if (fentry->flags & FILE_LIST_FLAG_CREATE)
+			flags |= O_CREAT;
+		else
+			return ret;
+	}
+
+	st = xzalloc(sizeof(*st));
+	INIT_LIST_HEAD(&st->bufs);
+	st->fentry = fentry;
+
+	st->fd = open(fentry->filename, flags);
+	if (st->fd < 0) {
+		ret = -errno;
+		goto err_free;
+	}
+
+	ret = fstat(st->fd, &s);
+	if (ret)
+		goto err_close;
+
+	st->is_reg = S_ISREG(s.st_mode);
+
+	st->thread = bthread_run(fastboot_stream_thread, st, "fastboot-stream");
+	if (!st->thread) {
+		ret = -ENOMEM;
+		goto err_close;
+	}
+
+	fb->stream = st;
+
+	return 0;
+
+err_close:
+	close(st->fd);
+err_free:
+	free(st);
+
+	return ret;
+}
+
+static int fastboot_stream_data(struct fastboot_stream *st, const void *buffer,
+				unsigned int len)
+{
+	if (st->ret)
+		return st->ret;
+
+	if (!st->received && len >= sizeof(struct sparse_header) &&
+	    is_sparse_image(buffer))
+		st->sparse = sparse_image_stream_new(fastboot_stream_write, st);
+
+	st->received += len;
+
+	while (len) {
+		struct fastboot_stream_buf *sb;
+		size_t now;
+
+		sb = list_empty(&st->bufs) ? NULL :
+			list_last_entry(&st->bufs, struct fastboot_stream_buf,
+					list);
+
+		if (!sb || sb->len == FASTBOOT_STREAM_BUF_SIZE) {
+			/*
+			 * Let the writer catch up. We may be called from
+			 * a poller while the writer itself waits for the
+			 * hardware though; waiting would deadlock then, so
+			 * go over the limit instead.
+			 */
+			while (st->nbufs >= FASTBOOT_STREAM_MAX_BUFS &&
+			       current != st->thread)
+				bthread_reschedule();
+
+			sb = malloc(sizeof(*sb));
+			if (!sb)
+				return -ENOMEM;
+
+			sb->len = 0;
+			sb->consumed = 0;
+			list_add_tail(&sb->list, &st->bufs);
+			st->nbufs++;
+		}
+
+		now = min_t(size_t, len, FASTBOOT_STREAM_BUF_SIZE - sb->len);
+		memcpy(sb->data + sb->len, buffer, now);
+
+		sb->len += now;
+		buffer += now;
+		len -= now;
+	}
+
+	return 0;
+}
+
+/*
+ * Wait for the writer thread to process the remaining data and check
+ * that the image was complete.
+ */
+static int fastboot_stream_finish(struct fastboot *fb)
+{
+	struct fastboot_stream *st = fb->stream;
+	loff_t size;
+	int ret;
+
+	st->done = true;
+	__bthread_stop(st->thread);
+	st->thread = NULL;
+
+	ret = st->ret;
+	if (ret)
+		return ret;
+
+	if (st->sparse) {
+		ret = sparse_image_stream_finish(st->sparse);
+		if (ret)
+			return ret;
+
+		size = sparse_image_stream_size(st->sparse);
+	} else {
+		size = st->end;
+	}
+
+	if (st->is_reg)
+		ret = ftruncate(st->fd, size);
+
+	return ret;
+}
+
+static void fastboot_stream_release(struct fastboot *fb)
+{
+	struct fastboot_stream *st = fb->stream;
+
+	if (!fastboot_streaming(fb))
+		return;
+
+	fb->stream = NULL;
+	st->abort = true;
+
+	if (st->thread && current == st->thread) {
+		/* can't wait for ourselves, the thread frees the stream */
+		st->detached = true;
+		bthread_cancel(st->thread);
+		return;
+	}
+
+	if (st->thread)
+		__bthread_stop(st->thread);
+
+	fastboot_stream_free(st);
+}
+
 void fastboot_generic_free(struct fastboot *fb)
 {
 	fastboot_free_variables(&fb->variables);
 
+	fastboot_stream_release(fb);
+	fastboot_release_buffer(fb);
 	free(fb->tempname);
 
 	fb->active = false;
@@ -349,9 +717,20 @@ int fastboot_handle_download_data(struct fastboot *fb, const void *buffer,
 {
 	int ret;
 
-	ret = write(fb->download_fd, buffer, len);
-	if (ret < 0)
-		return ret;
+	if (fastboot_streaming(fb)) {
+		ret = fastboot_stream_data(fb->stream, buffer, len);
+		if (ret)
+			return ret;
+	} else if (fb->download_buf) {
+		if (len > fb->download_size - fb->download_bytes)
+			return -ENOSPC;
+
+		memcpy(fb->download_buf + fb->download_bytes, buffer, len);
+	} else {
+		ret = write(fb->download_fd, buffer, len);
+		if (ret < 0)
+			return ret;
+	}
 
 	fb->download_bytes += len;
 	show_progress(fb->download_bytes);
@@ -360,8 +739,13 @@ int fastboot_handle_download_data(struct fastboot *fb, const void *buffer,
 
 void fastboot_download_finished(struct fastboot *fb)
 {
-	close(fb->download_fd);
-	fb->download_fd = 0;
+	if (fb->download_fd > 0) {
+		close(fb->download_fd);
+		fb->download_fd = 0;
+	}
+
+	if (fastboot_streaming(fb))
+		fb->stream->done = true;
 
 	printf("\n");
 
@@ -380,6 +764,8 @@ void fastboot_abort(struct fastboot *fb)
 
 	fb->active = false;
 
+	fastboot_stream_release(fb);
+	fastboot_release_buffer(fb);
 	unlink(fb->tempname);
 }
 
@@ -396,14 +782,45 @@ static void cb_download(struct fastboot *fb, const char *cmd)
 	if (fb->download_fd > 0) {
 		pr_err("%s called and %s is still opened\n", __func__, fb->tempname);
 		close(fb->download_fd);
+		fb->download_fd = 0;
 	}
 
-	fb->download_fd = open(fb->tempname, O_WRONLY | O_CREAT | O_TRUNC);
-	if (fb->download_fd < 0) {
-		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL, "internal error");
-			return;
+	fastboot_stream_release(fb);
+	fastboot_release_buffer(fb);
+
+	if (IS_ENABLED(CONFIG_FASTBOOT_SPARSE_STREAM) &&
+	    fastboot_stream_partition && *fastboot_stream_partition &&
+	    fb->download_size) {
+		int ret = fastboot_stream_start(fb);
+
+		if (!ret) {
+			fastboot_tx_print(fb, FASTBOOT_MSG_INFO,
+					  "Writing to %s while downloading",
+					  fastboot_stream_partition);
+			unlink(fb->tempname);
+			goto start;
+		}
+
+		pr_warn("Cannot write to %s while downloading: %pe\n",
+			fastboot_stream_partition, ERR_PTR(ret));
+	}
+
+	if (fastboot_download_buffer && fb->download_size &&
+	    !fastboot_alloc_buffer(fb)) {
+		unlink(fb->tempname);
+	} else {
+		if (fastboot_download_buffer && fb->download_size)
+			pr_warn("Cannot allocate download buffer, using %s\n",
+				fb->tempname);
+
+		fb->download_fd = open(fb->tempname, O_WRONLY | O_CREAT | O_TRUNC);
+		if (fb->download_fd < 0) {
+			fastboot_tx_print(fb, FASTBOOT_MSG_FAIL, "internal error");
+				return;
+		}
 	}
 
+start:
 	if (!fb->download_size)
 		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
 					  "data invalid size");
@@ -429,7 +846,7 @@ static void __maybe_unused cb_boot(struct fastboot *fb, const char *opt)
 	globalvar_set_match("linux.bootargs.dyn.", "");
 	globalvar_set("bootm.image", "");
 
-	data.os_file = fb->tempname;
+	data.os_file = fb->download_file;
 
 	ret = bootm_boot(&data);
 
@@ -557,7 +974,7 @@ static int fastboot_handle_sparse(struct fastboot *fb,
 	if (ret)
 		goto out_close_fd;
 
-	sparse = sparse_image_open(fb->tempname);
+	sparse = sparse_image_open(fb->download_file);
 	if (IS_ERR(sparse)) {
 		pr_err("Cannot open sparse image\n");
 		ret = PTR_ERR(sparse);
@@ -648,7 +1065,25 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 	const char *filename = NULL;
 	enum filetype filetype;
 
-	ret = file_name_detect_type(fb->tempname, &filetype);
+	if (fastboot_streaming(fb)) {
+		const char *target = fb->stream->fentry->name;
+
+		if (strcmp(cmd, target)) {
+			fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+					  "Download was written to %s", target);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		ret = fastboot_stream_finish(fb);
+		if (ret)
+			fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+					  "write partition: %s", strerror(-ret));
+
+		goto out;
+	}
+
+	ret = file_name_detect_type(fb->download_file, &filetype);
 	if (ret) {
 		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL, "internal error");
 		goto out;
@@ -668,7 +1103,8 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 
 	/* Check if board-code registered a vendor-specific handler */
 	if (fb->cmd_flash) {
-		ret = fb->cmd_flash(fb, fentry, fb->tempname, fb->download_size);
+		ret = fb->cmd_flash(fb, fentry, fb->download_file,
+				    fb->download_size);
 		if (ret != FASTBOOT_CMD_FALLTHROUGH)
 			goto out;
 	}
@@ -701,7 +1137,7 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 
 		mtd = get_mtd(fb, fentry->filename);
 
-		ret = do_ubiformat(fb, mtd, fb->tempname, fb->download_size);
+		ret = do_ubiformat(fb, mtd, fb->download_file, fb->download_size);
 		if (ret) {
 			fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
 					  "write partition: %s",
@@ -714,7 +1150,7 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 
 	if (IS_ENABLED(CONFIG_BAREBOX_UPDATE) &&
 	    (filetype_is_barebox_image(filetype) || strstarts(fentry->name, "bbu-"))) {
-		void *buf;
+		void *buf = NULL;
 		struct bbu_handler *handler;
 		struct bbu_data data = {
 			.devicefile = filename,
@@ -728,16 +1164,22 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 		fastboot_tx_print(fb, FASTBOOT_MSG_INFO,
 				  "This is a barebox image...");
 
-		ret = read_file_2(fb->tempname, &data.len, &buf,
-				fb->download_size);
-		if (ret) {
-			fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
-					  "reading barebox");
-			goto out;
+		if (fb->download_buf) {
+			data.image = fb->download_buf;
+			data.len = fb->download_bytes;
+		} else {
+			ret = read_file_2(fb->tempname, &data.len, &buf,
+					fb->download_size);
+			if (ret) {
+				fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
+						  "reading barebox");
+				goto out;
+			}
+
+			data.image = buf;
 		}
 
-		data.image = buf;
-		data.imagefile = fb->tempname;
+		data.imagefile = fb->download_file;
 
 		ret = barebox_update(&data, handler);
 
@@ -751,7 +1193,7 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 	}
 
 copy:
-	ret = copy_file(fb->tempname, filename, 1);
+	ret = copy_file(fb->download_file, filename, 1);
 	if (ret)
 		fastboot_tx_print(fb, FASTBOOT_MSG_FAIL,
 				  "write partition: %s", strerror(-ret));
@@ -760,6 +1202,8 @@ static void cb_flash(struct fastboot *fb, const char *cmd)
 	if (!ret)
 		fastboot_tx_print(fb, FASTBOOT_MSG_OKAY, "");
 
+	fastboot_stream_release(fb);
+	fastboot_release_buffer(fb);
 	unlink(fb->tempname);
 }
 
@@ -980,8 +1424,13 @@ static int fastboot_globalvars_init(void)
 	}
 
 	globalvar_add_simple_bool("fastboot.bbu", &fastboot_bbu);
+	globalvar_add_simple_bool("fastboot.download_buffer",
+				  &fastboot_download_buffer);
 	globalvar_add_simple_string("fastboot.partitions",
 				    &fastboot_partitions);
+	if (IS_ENABLED(CONFIG_FASTBOOT_SPARSE_STREAM))
+		globalvar_add_simple_string("fastboot.stream_partition",
+					    &fastboot_stream_partition);
 
 	globalvar_alias_deprecated("usbgadget.fastboot_function",
 				   "fastboot.partitions");
@@ -1001,3 +1450,7 @@ BAREBOX_MAGICVAR(global.fastboot.partitions,
 		       "Partitions exported for update via fastboot");
 BAREBOX_MAGICVAR(global.fastboot.bbu,
 		       "Export barebox update handlers via fastboot");
+BAREBOX_MAGICVAR(global.fastboot.download_buffer,
+		       "Download into a contiguous memory buffer instead of a ramfs file");
+BAREBOX_MAGICVAR(global.fastboot.stream_partition,
+		       "Partition downloads are written to while they are received");
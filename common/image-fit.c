@@ -19,8 +19,10 @@
 #include <asm/byteorder.h>
 #include <errno.h>
 #include <linux/err.h>
+#include <linux/sizes.h>
 #include <stringlist.h>
 #include <rsa.h>
+#include <crypto.h>
 #include <uncompress.h>
 #include <image-fit.h>
 
@@ -328,7 +330,14 @@ static int fit_verify_signature(struct device_node *sig_node, const void *fit)
 		goto out_sl;
 	}
 
+	/*
+	 * mkimage signs before it moves the data out of the FIT for images
+	 * with external data, so the properties describing it are not hashed.
+	 */
 	string_list_add(&exc_props, "data");
+	string_list_add(&exc_props, "data-size");
+	string_list_add(&exc_props, "data-position");
+	string_list_add(&exc_props, "data-offset");
 
 	digest = fit_alloc_digest(sig_node, &algo);
 	if (IS_ERR(digest)) {
@@ -357,12 +366,55 @@ static int fit_verify_signature(struct device_node *sig_node, const void *fit)
 	return ret;
 }
 
-static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
-			   const void *data, int data_len)
+/*
+ * Verification state of a single image. The digest is fed with the image
+ * data while it is read, so that reading and hashing can be interleaved.
+ */
+struct fit_image_verify {
+	struct digest *digest;
+	struct device_node *node;	/* hash or signature node */
+	enum hash_algo algo;		/* signature only */
+	bool signature;
+};
+
+static struct device_node *fit_get_hash_node(struct device_node *image)
+{
+	struct device_node *hash;
+
+	hash = of_get_child_by_name(image, "hash-1");
+	if (!hash)
+		hash = of_get_child_by_name(image, "hash@1");
+
+	return hash;
+}
+
+static bool fit_image_is_hashed(struct fit_handle *handle,
+				struct device_node *image)
+{
+	unsigned int i;
+
+	for (i = 0; i < handle->num_hashed_images; i++)
+		if (handle->hashed_images[i] == image)
+			return true;
+
+	return false;
+}
+
+static void fit_add_hashed_image(struct fit_handle *handle,
+				 struct device_node *image)
+{
+	handle->hashed_images = xrealloc(handle->hashed_images,
+					 (handle->num_hashed_images + 1) *
+					 sizeof(*handle->hashed_images));
+	handle->hashed_images[handle->num_hashed_images++] = image;
+}
+
+static int fit_verify_hash_start(struct fit_handle *handle,
+				 struct device_node *image,
+				 struct fit_image_verify *v)
 {
 	struct digest *d;
 	const char *algo;
-	const char *value_read;
 	int hash_len, ret;
 	struct device_node *hash;
 
@@ -376,17 +428,14 @@ static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
 		ret = -EINVAL;
 	}
 
-	hash = of_get_child_by_name(image, "hash-1");
-	if (!hash)
-		hash = of_get_child_by_name(image, "hash@1");
+	hash = fit_get_hash_node(image);
 	if (!hash) {
 		if (ret)
 			pr_err("image %pOF does not have hashes\n", image);
 		return ret;
 	}
 
-	value_read = of_get_property(hash, "value", &hash_len);
-	if (!value_read) {
+	if (!of_get_property(hash, "value", &hash_len)) {
 		pr_err("%pOF: \"value\" property not found\n", hash);
 		return -EINVAL;
 	}
@@ -404,35 +453,24 @@ static int fit_verify_hash(struct fit_handle *handle, struct device_node *image,
 
 	if (hash_len != digest_length(d)) {
 		pr_err("%pOF: invalid hash length %d\n", hash, hash_len);
-		ret = -EINVAL;
-		goto err_digest_free;
+		digest_free(d);
+		return -EINVAL;
 	}
 
 	digest_init(d);
-	digest_update(d, data, data_len);
 
-	if (digest_verify(d, value_read)) {
-		pr_info("%pOF: hash BAD\n", hash);
-		ret =  -EBADMSG;
-	} else {
-		pr_info("%pOF: hash OK\n", hash);
-		ret = 0;
-	}
+	v->digest = d;
+	v->node = hash;
 
-err_digest_free:
-	digest_free(d);
-
-	return ret;
+	return 0;
 }
 
-static int fit_image_verify_signature(struct fit_handle *handle,
+static int fit_verify_signature_start(struct fit_handle *handle,
 				      struct device_node *image,
-				      const void *data, int data_len)
+				      struct fit_image_verify *v)
 {
 	struct digest *digest;
 	struct device_node *sig_node;
-	enum hash_algo algo = 0;
-	void *hash;
 	int ret;
 
 	if (!IS_ENABLED(CONFIG_FITIMAGE_SIGNATURE))
@@ -456,19 +494,70 @@ static int fit_image_verify_signature(struct fit_handle *handle,
 		return ret;
 	}
 
-	digest = fit_alloc_digest(sig_node, &algo);
+	digest = fit_alloc_digest(sig_node, &v->algo);
 	if (IS_ERR(digest))
 		return PTR_ERR(digest);
 
-	digest_update(digest, data, data_len);
-	hash = xzalloc(digest_length(digest));
-	digest_final(digest, hash);
+	v->digest = digest;
+	v->node = sig_node;
+	v->signature = true;
 
-	ret = fit_check_rsa_signature(sig_node, algo, hash);
+	return 0;
+}
 
-	free(hash);
+/*
+ * Prepare verification of an image. Images opened as part of a
+ * configuration only have their hash checked, because opening the
+ * configuration already checked the signature of all involved nodes.
+ * The hash may even have been checked along with the other images of the
+ * configuration already. Other images have their own signature checked.
+ * If nothing is to be verified, v->digest is left NULL.
+ */
+static int fit_image_verify_start(struct fit_handle *handle,
+				  struct device_node *image,
+				  bool configuration,
+				  struct fit_image_verify *v)
+{
+	memset(v, 0, sizeof(*v));
 
-	digest_free(digest);
+	if (!configuration)
+		return fit_verify_signature_start(handle, image, v);
+
+	if (fit_image_is_hashed(handle, image))
+		return 0;
+
+	return fit_verify_hash_start(handle, image, v);
+}
+
+/*
+ * Check the digest of all data fed in since fit_image_verify_start()
+ */
+static int fit_image_verify_finish(struct fit_image_verify *v)
+{
+	void *hash;
+	int ret;
+
+	if (!v->digest)
+		return 0;
+
+	if (v->signature) {
+		hash = xzalloc(digest_length(v->digest));
+		digest_final(v->digest, hash);
+
+		ret = fit_check_rsa_signature(v->node, v->algo, hash);
+
+		free(hash);
+	} else if (digest_verify(v->digest,
+				 of_get_property(v->node, "value", NULL))) {
+		pr_info("%pOF: hash BAD\n", v->node);
+		ret = -EBADMSG;
+	} else {
+		pr_info("%pOF: hash OK\n", v->node);
+		ret = 0;
+	}
+
+	digest_free(v->digest);
+	v->digest = NULL;
 
 	return ret;
 }
@@ -565,19 +654,150 @@ int fit_get_image_address(struct fit_handle *handle, void *configuration,
 	return ret;
 }
 
+#define FIT_READ_CHUNK_SIZE	SZ_256K
+
+/*
+ * Read image data stored outside of the FDT structure (mkimage -E) from
+ * the FIT file. If @digest is given, each chunk is fed into it right
+ * after it has been read while it's still hot in the cache.
+ */
+static int fit_read_external_data(struct fit_handle *handle, loff_t pos,
+				  void *buf, size_t size, struct digest *digest)
+{
+	int fd, ret = 0;
+
+	fd = open_and_lseek(handle->filename, O_RDONLY, pos);
+	if (fd < 0)
+		return fd;
+
+	while (size) {
+		size_t now = min_t(size_t, size, FIT_READ_CHUNK_SIZE);
+
+		ret = read_full(fd, buf, now);
+		if (ret < 0)
+			break;
+		if (ret < now) {
+			ret = -ENODATA;
+			break;
+		}
+
+		if (digest)
+			digest_update(digest, buf, now);
+
+		buf += now;
+		size -= now;
+		ret = 0;
+	}
+
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * Get the position and size of external image data relative to the start
+ * of the FIT image.
+ */
+static int fit_get_external_data_pos(struct fit_handle *handle,
+				     struct device_node *image,
+				     loff_t *pos, u32 *size)
+{
+	const struct fdt_header *fdt = handle->fit;
+	u32 offset;
+
+	if (of_property_read_u32(image, "data-size", size)) {
+		pr_err("data not found\n");
+		return -EINVAL;
+	}
+
+	if (!of_property_read_u32(image, "data-position", &offset)) {
+		*pos = offset;
+	} else if (!of_property_read_u32(image, "data-offset", &offset)) {
+		*pos = ALIGN(fdt32_to_cpu(fdt->totalsize), 4) + (loff_t)offset;
+	} else {
+		pr_err("%pOF: no data-position or data-offset\n", image);
+		return -EINVAL;
+	}
+
+	if (*size > INT_MAX)
+		return -EFBIG;
+
+	return 0;
+}
+
+/*
+ * Get the data of an image. The data is either embedded in the "data"
+ * property or, for FIT images with external data, described by the
+ * "data-size" and "data-position"/"data-offset" properties. In the
+ * latter case the data is read on demand and attached to the image node
+ * so that it's read only once and freed during fit_close().
+ *
+ * If @digest is non NULL and the data is read from the file, it's fed into
+ * @digest while being read and *@digested is set to true.
+ */
+static int fit_get_image_data(struct fit_handle *handle,
+			      struct device_node *image,
+			      const void **data, int *data_len,
+			      struct digest *digest, bool *digested)
+{
+	u32 size;
+	loff_t pos;
+	void *buf;
+	int ret;
+
+	*data = of_get_property(image, "data", data_len);
+	if (*data)
+		return 0;
+
+	ret = fit_get_external_data_pos(handle, image, &pos, &size);
+	if (ret)
+		return ret;
+
+	if (pos + size <= handle->size) {
+		*data = handle->fit + pos;
+		*data_len = size;
+		return 0;
+	}
+
+	if (!handle->filename) {
+		pr_err("%pOF: external data beyond end of FIT\n", image);
+		return -EINVAL;
+	}
+
+	buf = malloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = fit_read_external_data(handle, pos, buf, size, digest);
+	if (ret) {
+		pr_err("%pOF: reading external data failed: %pe\n",
+		       image, ERR_PTR(ret));
+		free(buf);
+		return ret;
+	}
+
+	__of_new_property(image, "data", buf, size);
+
+	*data = buf;
+	*data_len = size;
+	if (digested)
+		*digested = digest != NULL;
+
+	return 0;
+}
+
 static void fit_uncompress_error_fn(char *x)
 {
 	pr_err("%s\n", x);
 }
 
-static int fit_handle_decompression(struct device_node *image,
-				    const char *type,
-				    const void **data,
-				    int *data_len)
+/*
+ * Returns 1 if the image data has to be decompressed, 0 if not and a
+ * negative error code if it can't be decompressed.
+ */
+static int fit_image_is_compressed(struct device_node *image, const char *type)
 {
 	const char *compression = NULL;
-	void *uc_data;
-	int ret;
 
 	of_property_read_string(image, "compression", &compression);
 	if (!compression || !strcmp(compression, "none"))
@@ -595,6 +815,15 @@ static int fit_handle_decompression(struct device_node *image,
 		return -ENOSYS;
 	}
 
+	return 1;
+}
+
+static int fit_uncompress_buf(struct device_node *image,
+			      const void **data, int *data_len)
+{
+	void *uc_data;
+	int ret;
+
 	ret = uncompress_buf_to_buf(*data, *data_len, &uc_data,
 				    fit_uncompress_error_fn);
 	if (ret < 0) {
@@ -611,6 +840,105 @@ static int fit_handle_decompression(struct device_node *image,
 	return 0;
 }
 
+static int fit_handle_decompression(struct device_node *image,
+				    const char *type,
+				    const void **data,
+				    int *data_len)
+{
+	int ret;
+
+	ret = fit_image_is_compressed(image, type);
+	if (ret <= 0)
+		return ret;
+
+	return fit_uncompress_buf(image, data, data_len);
+}
+
+static int fit_uncompress_fd;
+static size_t fit_uncompress_remaining;
+
+static long fit_uncompress_fill(void *buf, unsigned long len)
+{
+	int ret;
+
+	ret = read_full(fit_uncompress_fd, buf,
+			min_t(size_t, len, fit_uncompress_remaining));
+	if (ret > 0)
+		fit_uncompress_remaining -= ret;
+
+	return ret;
+}
+
+/* Get the uncompressed size if it's stored with the compressed data */
+static size_t fit_uncompress_size_hint(int fd, loff_t pos, u32 size)
+{
+	u8 head[32], tail[4];
+
+	if (size < sizeof(head))
+		return 0;
+
+	if (pread_full(fd, head, sizeof(head), pos) != sizeof(head) ||
+	    pread_full(fd, tail, sizeof(tail), pos + size - sizeof(tail)) != sizeof(tail))
+		return 0;
+
+	return uncompress_size_hint(head, sizeof(head), tail);
+}
+
+/*
+ * Decompress external image data while reading it from the file, so that
+ * the compressed data never has to be buffered as a whole. This is only
+ * possible when the data doesn't have to be verified, as unverified data
+ * must not be passed to the decompressor. Returns -ENOENT if the data is
+ * not read from the file and the normal path has to be taken.
+ */
+static int fit_uncompress_stream(struct fit_handle *handle,
+				 struct device_node *image,
+				 const void **data, int *data_len)
+{
+	void *uc_data;
+	loff_t pos;
+	u32 size;
+	int fd, ret;
+
+	if (!handle->filename || of_property_present(image, "data"))
+		return -ENOENT;
+
+	*data = of_get_property(image, "uncompressed-data", data_len);
+	if (*data)
+		return 0;
+
+	ret = fit_get_external_data_pos(handle, image, &pos, &size);
+	if (ret)
+		return ret;
+
+	if (pos + size <= handle->size)
+		return -ENOENT;
+
+	fd = open_and_lseek(handle->filename, O_RDONLY, pos);
+	if (fd < 0)
+		return fd;
+
+	fit_uncompress_fd = fd;
+	fit_uncompress_remaining = size;
+
+	ret = uncompress_fill_to_buf(fit_uncompress_fill,
+				     fit_uncompress_size_hint(fd, pos, size),
+				     &uc_data, fit_uncompress_error_fn);
+	close(fd);
+	if (ret < 0) {
+		pr_err("data couldn't be decompressed\n");
+		return ret;
+	}
+
+	*data = uc_data;
+	*data_len = ret;
+
+	/* associate buffer with FIT, so it's not leaked */
+	__of_new_property(image, "uncompressed-data", uc_data, *data_len);
+
+	return 0;
+}
+
 /**
  * fit_open_image - Open an image in a FIT image
  * @handle: The FIT image handle
@@ -634,8 +962,11 @@ int fit_open_image(struct fit_handle *handle, void *configuration,
 {
 	struct device_node *image;
 	const char *unit = name, *type = NULL, *desc= "(no description)";
+	struct fit_image_verify verify;
+	bool digested = false;
 	const void *data;
 	int data_len;
+	int compressed;
 	int ret = 0;
 
 	ret = fit_get_image(handle, configuration, &unit, &image);
@@ -651,24 +982,43 @@ int fit_open_image(struct fit_handle *handle, void *configuration,
 		return -EINVAL;
 	}
 
-	data = of_get_property(image, "data", &data_len);
-	if (!data) {
-		pr_err("data not found\n");
-		return -EINVAL;
-	}
-
-	if (configuration)
-		ret = fit_verify_hash(handle, image, data, data_len);
-	else
-		ret = fit_image_verify_signature(handle, image, data, data_len);
+	compressed = fit_image_is_compressed(image, type);
+	if (compressed < 0)
+		return compressed;
 
+	ret = fit_image_verify_start(handle, image, configuration, &verify);
 	if (ret < 0)
 		return ret;
 
-	ret = fit_handle_decompression(image, type, &data, &data_len);
-	if (ret)
+	if (compressed && !verify.digest) {
+		ret = fit_uncompress_stream(handle, image, &data, &data_len);
+		if (ret != -ENOENT) {
+			if (ret)
+				return ret;
+			goto out;
+		}
+	}
+
+	ret = fit_get_image_data(handle, image, &data, &data_len,
+				 verify.digest, &digested);
+	if (ret) {
+		digest_free(verify.digest);
 		return ret;
+	}
 
+	if (verify.digest && !digested)
+		digest_update(verify.digest, data, data_len);
+
+	ret = fit_image_verify_finish(&verify);
+	if (ret < 0)
+		return ret;
+
+	if (compressed) {
+		ret = fit_uncompress_buf(image, &data, &data_len);
+		if (ret)
+			return ret;
+	}
+out:
 	*outdata = data;
 	*outsize = data_len;
 
@@ -715,6 +1065,175 @@ static int fit_config_verify_signature(struct fit_handle *handle, struct device_
 	return ret;
 }
 
+struct fit_image_hash {
+	struct device_node *image;
+	struct device_node *hash;
+	const char *algo;
+	const void *value;
+	int len;
+	struct digest_mb_req req;
+	bool done;
+};
+
+/*
+ * Collect the images referenced by a configuration that have a hash and
+ * whose data is already in memory, either embedded or as external data
+ * within the part of the FIT that has been read. Each image is collected
+ * once, even if the configuration references it several times.
+ */
+static struct fit_image_hash *fit_config_collect_hashes(struct fit_handle *handle,
+							 struct device_node *conf_node,
+							 unsigned int *num)
+{
+	struct fit_image_hash *h = NULL, *e;
+	struct property *pp, *prop;
+	const char *unit;
+	unsigned int i;
+
+	*num = 0;
+
+	for_each_property_of_node(conf_node, pp) {
+		if (!strcmp(pp->name, "description") ||
+		    !strcmp(pp->name, "compatible"))
+			continue;
+
+		of_property_for_each_string(conf_node, pp->name, prop, unit) {
+			struct device_node *image, *hash;
+			const void *data, *value;
+			const char *algo;
+			int len, size;
+			loff_t pos;
+
+			image = of_get_child_by_name(handle->images, unit);
+			if (!image || fit_image_is_hashed(handle, image))
+				continue;
+
+			for (i = 0; i < *num; i++)
+				if (h[i].image == image)
+					break;
+			if (i < *num)
+				continue;
+
+			hash = fit_get_hash_node(image);
+			if (!hash)
+				continue;
+
+			value = of_get_property(hash, "value", &len);
+			if (!value || of_property_read_string(hash, "algo", &algo))
+				continue;
+
+			data = of_get_property(image, "data", &size);
+			if (!data) {
+				u32 ext_size;
+
+				if (!of_property_present(image, "data-size") ||
+				    fit_get_external_data_pos(handle, image,
+							      &pos, &ext_size) ||
+				    pos + ext_size > handle->size)
+					continue;
+
+				data = handle->fit + pos;
+				size = ext_size;
+			}
+
+			h = xrealloc(h, (*num + 1) * sizeof(*h));
+			e = &h[(*num)++];
+			memset(e, 0, sizeof(*e));
+
+			e->image = image;
+			e->hash = hash;
+			e->algo = algo;
+			e->value = value;
+			e->len = len;
+			e->req.data = data;
+			e->req.len = size;
+		}
+	}
+
+	return h;
+}
+
+/*
+ * Check the hashes of the images referenced by a configuration in one go,
+ * so that a multi-buffer digest can process them in parallel. Images that
+ * pass are recorded in the handle and not hashed again when they are
+ * opened. Anything this doesn't cover, like images read from the file on
+ * demand or hash nodes with errors, is left to fit_open_image().
+ */
+static int fit_config_verify_hashes(struct fit_handle *handle,
+				    struct device_node *conf_node)
+{
+	struct fit_image_hash *h;
+	struct digest_mb_req *reqs;
+	unsigned int num, i, j, n;
+	struct digest *d;
+	int ret = 0;
+
+	if (handle->verify == BOOTM_VERIFY_NONE)
+		return 0;
+
+	h = fit_config_collect_hashes(handle, conf_node, &num);
+	if (!num)
+		goto out;
+
+	reqs = xmalloc(num * sizeof(*reqs));
+
+	for (i = 0; i < num && !ret; i++) {
+		if (h[i].done)
+			continue;
+
+		d = digest_alloc(h[i].algo);
+
+		/* group all images using the same algorithm */
+		for (j = i, n = 0; j < num; j++) {
+			if (h[j].done || strcmp(h[j].algo, h[i].algo))
+				continue;
+
+			h[j].done = true;
+
+			if (!d || h[j].len != digest_length(d))
+				continue;
+
+			h[j].req.out = xmalloc(h[j].len);
+			reqs[n++] = h[j].req;
+		}
+
+		digest_free(d);
+
+		if (!n)
+			continue;
+
+		ret = digest_mb(h[i].algo, reqs, n);
+		if (ret) {
+			pr_err("%pOF: calculating %s failed: %pe\n", conf_node,
+			       h[i].algo, ERR_PTR(ret));
+			break;
+		}
+
+		for (j = i; j < num; j++) {
+			if (!h[j].req.out || strcmp(h[j].algo, h[i].algo))
+				continue;
+
+			if (crypto_memneq(h[j].req.out, h[j].value, h[j].len)) {
+				pr_info("%pOF: hash BAD\n", h[j].hash);
+				ret = -EBADMSG;
+				continue;
+			}
+
+			pr_info("%pOF: hash OK\n", h[j].hash);
+			fit_add_hashed_image(handle, h[j].image);
+		}
+	}
+
+	for (i = 0; i < num; i++)
+		free(h[i].req.out);
+	free(reqs);
+out:
+	free(h);
+
+	return ret;
+}
+
 static int fit_find_compatible_unit(struct fit_handle *handle,
 				    struct device_node *conf_node,
 				    const char **unit)
@@ -748,11 +1267,10 @@ static int fit_find_compatible_unit(struct fit_handle *handle,
 			if (ret)
 				goto next;
 
-			data = of_get_property(image, "data", &data_len);
-			if (!data) {
-				ret = -EINVAL;
+			ret = fit_get_image_data(handle, image, &data, &data_len,
+						 NULL, NULL);
+			if (ret)
 				goto next;
-			}
 
 			ret = fit_handle_decompression(image, "fdt", &data, &data_len);
 			if (ret) {
@@ -834,6 +1352,10 @@ void *fit_open_configuration(struct fit_handle *handle, const char *name)
 	if (ret)
 		return ERR_PTR(ret);
 
+	ret = fit_config_verify_hashes(handle, conf_node);
+	if (ret)
+		return ERR_PTR(ret);
+
 	return conf_node;
 }
 
@@ -895,6 +1417,32 @@ struct fit_handle *fit_open_buf(const void *buf, size_t size, bool verbose,
 	return handle;
 }
 
+/*
+ * Read the FDT part of a FIT image. Image data stored outside of the FDT
+ * is not read here, but on demand by fit_get_image_data().
+ */
+static int fit_read_fdt(struct fit_handle *handle, const char *filename,
+			loff_t max_size)
+{
+	struct fdt_header header;
+	ssize_t len;
+	int ret;
+
+	len = read_file_into_buf(filename, &header, sizeof(header));
+	if (len < 0)
+		return len;
+
+	if (len == sizeof(header) && fdt32_to_cpu(header.magic) == FDT_MAGIC)
+		max_size = min_t(loff_t, max_size, fdt32_to_cpu(header.totalsize));
+
+	ret = read_file_2(filename, &handle->size, &handle->fit_alloc,
+			  max_size);
+	if (ret && ret != -EFBIG)
+		return ret;
+
+	return 0;
+}
+
 /**
  * fit_open - open a FIT image
  * @filename:	The filename of the FIT image
@@ -903,7 +1451,8 @@ struct fit_handle *fit_open_buf(const void *buf, size_t size, bool verbose,
  * @max_size:	maximum length to read from file
  *
  * This opens a FIT image found in @filename. The returned handle is used as
- * context for the other FIT functions.
+ * context for the other FIT functions. Only the FDT part of the FIT image
+ * is read here, external image data is read when the image is opened.
  *
  * Return: A handle to a FIT image or a ERR_PTR
  */
@@ -917,11 +1466,12 @@ struct fit_handle *fit_open(const char *filename, bool verbose,
 
 	handle->verbose = verbose;
 	handle->verify = verify;
+	handle->filename = xstrdup(filename);
 
-	ret = read_file_2(filename, &handle->size, &handle->fit_alloc,
-			  max_size);
-	if (ret && ret != -EFBIG) {
+	ret = fit_read_fdt(handle, filename, max_size);
+	if (ret) {
 		pr_err("unable to read %s: %s\n", filename, strerror(-ret));
+		fit_close(handle);
 		return ERR_PTR(ret);
 	}
 
@@ -941,7 +1491,9 @@ void fit_close(struct fit_handle *handle)
 	if (handle->root)
 		of_delete_node(handle->root);
 
+	free(handle->hashed_images);
 	free(handle->fit_alloc);
+	free(handle->filename);
 	free(handle);
 }
 
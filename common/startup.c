@@ -40,6 +40,7 @@
 #include <net.h>
 #include <efi/efi-mode.h>
 #include <bselftest.h>
+#include <boot-profile.h>
 
 extern initcall_t __barebox_initcalls_start[], __barebox_early_initcalls_end[],
 		  __barebox_initcalls_end[];
@@ -352,8 +353,12 @@ void __noreturn start_barebox(void)
 
 	for (initcall = __barebox_initcalls_start;
 			initcall < __barebox_initcalls_end; initcall++) {
+		struct boot_profile_event *ev;
+
 		pr_debug("initcall-> %pS\n", *initcall);
+		ev = boot_profile_start(BOOT_PROFILE_INITCALL, NULL, *initcall);
 		result = (*initcall)();
+		boot_profile_end(ev, result);
 		if (result)
 			pr_err("initcall %pS failed: %s\n", *initcall,
 					strerror(-result));
@@ -361,6 +366,8 @@ void __noreturn start_barebox(void)
 
 	pr_debug("initcalls done\n");
 
+	boot_profile_stop();
+
 	if (IS_ENABLED(CONFIG_SELFTEST_AUTORUN))
 		selftests_run();
 
@@ -22,7 +22,17 @@
 #define STATIC static inline
 #endif
 
-static uint32_t crc_table[sizeof(uint32_t) * 256];
+/*
+ * Slicing-by-8 needs eight tables of 1KiB each, which is too much for the
+ * prebootloader. It processes the input one byte at a time instead.
+ */
+#ifdef __PBL__
+#define CRC32_SLICES	1
+#else
+#define CRC32_SLICES	8
+#endif
+
+static uint32_t crc_table[CRC32_SLICES][256];
 
 /*
   Generate a table for a byte-wise 32-bit CRC calculation on the polynomial:
@@ -47,6 +57,10 @@ static uint32_t crc_table[sizeof(uint32_t) * 256];
   The table is simply the CRC of all possible eight bit values.  This is all
   the information needed to generate CRC's on data a byte at a time for all
   combinations of CRC register values and incoming bytes.
+
+  Table k holds the CRC of each byte followed by k zero bytes, so that eight
+  bytes can be looked up independently of each other and combined with
+  exclusive-or.
 */
 static void make_crc_table(void)
 {
@@ -56,7 +70,7 @@ static void make_crc_table(void)
 	/* terms of polynomial defining this crc (except x^32): */
 	static const char p[] = { 0, 1, 2, 4, 5, 7, 8, 10, 11, 12, 16, 22, 23, 26 };
 
-	if (crc_table[1])
+	if (crc_table[0][1])
 		return;
 
 	/* make exclusive-or pattern from polynomial (0xedb88320L) */
@@ -68,36 +82,70 @@ static void make_crc_table(void)
 		c = (uint32_t) n;
 		for (k = 0; k < 8; k++)
 			c = c & 1 ? poly ^ (c >> 1) : c >> 1;
-		crc_table[n] = c;
+		crc_table[0][n] = c;
+	}
+
+	for (n = 0; n < 256; n++) {
+		c = crc_table[0][n];
+		for (k = 1; k < CRC32_SLICES; k++) {
+			c = crc_table[0][c & 0xff] ^ (c >> 8);
+			crc_table[k][n] = c;
+		}
 	}
 }
 
-#define DO1(buf) crc = crc_table[((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
-#define DO2(buf)  DO1(buf); DO1(buf);
-#define DO4(buf)  DO2(buf); DO2(buf);
-#define DO8(buf)  DO4(buf); DO4(buf);
+#define DO1(buf) crc = crc_table[0][((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
+
+/* little endian load, compilers turn this into a single load where possible */
+#define LE32(buf) ((uint32_t)(buf)[0] | (uint32_t)(buf)[1] << 8 | \
+		   (uint32_t)(buf)[2] << 16 | (uint32_t)(buf)[3] << 24)
 
 /* No ones complement version. JFFS2 (and other things ?)
  * don't use ones compliment in their CRC calculations.
  */
-STATIC uint32_t crc32_no_comp(uint32_t crc, const void *_buf, unsigned int len)
+STATIC uint32_t crc32_le_generic(uint32_t crc, const void *_buf, unsigned int len)
 {
 	const unsigned char *buf = _buf;
 
 	make_crc_table();
 
+#if CRC32_SLICES == 8
 	while (len >= 8) {
-		DO8(buf);
+		uint32_t q = crc ^ LE32(buf);
+		uint32_t r = LE32(buf + 4);
+
+		crc = crc_table[7][q & 0xff] ^
+		      crc_table[6][(q >> 8) & 0xff] ^
+		      crc_table[5][(q >> 16) & 0xff] ^
+		      crc_table[4][q >> 24] ^
+		      crc_table[3][r & 0xff] ^
+		      crc_table[2][(r >> 8) & 0xff] ^
+		      crc_table[1][(r >> 16) & 0xff] ^
+		      crc_table[0][r >> 24];
+
+		buf += 8;
 		len -= 8;
 	}
-	if (len)
-		do {
-			DO1(buf);
-		} while (--len);
+#endif
+	while (len--)
+		DO1(buf);
 
 	return crc;
 }
 
+#ifdef __BAREBOX__
+EXPORT_SYMBOL(crc32_le_generic);
+#endif
+
+STATIC uint32_t crc32_no_comp(uint32_t crc, const void *buf, unsigned int len)
+{
+#if defined(CONFIG_CRC32_ARCH) && !defined(__PBL__)
+	return crc32_le_arch(crc, buf, len);
+#else
+	return crc32_le_generic(crc, buf, len);
+#endif
+}
+
 STATIC uint32_t crc32(uint32_t crc, const void *buf, unsigned int len)
 {
 	return ~crc32_no_comp(~crc, buf, len);
@@ -24,6 +24,7 @@
 #include <crc.h>
 #include <asm/unaligned.h>
 #include <asm/byteorder.h>
+#include <linux/sizes.h>
 
 #include <crypto/crc.h>
 #include <crypto/internal.h>
@@ -44,6 +45,21 @@ static int crc32_update(struct digest *desc, const void *data,
 
 	while (len) {
 		int now = min((ulong)4096, len);
+		ctx->crc = ~crc32_le_generic(~ctx->crc, data, now);
+		len -= now;
+		data += now;
+	}
+
+	return 0;
+}
+
+static int crc32_arch_update(struct digest *desc, const void *data,
+			     unsigned long len)
+{
+	struct crc32_state *ctx = digest_ctx(desc);
+
+	while (len) {
+		int now = min((ulong)SZ_1M, len);
 		ctx->crc = crc32(ctx->crc, data, now);
 		len -= now;
 		data += now;
@@ -83,6 +99,37 @@ static struct digest_algo m = {
 	.ctx_length = sizeof(struct crc32_state),
 };
 
+static struct digest_algo m_arch = {
+	.base = {
+		.name		=	"crc32",
+		.priority	=	100,
+		.algo		=	HASH_ALGO_CRC32,
+	},
+
+	.init		= crc32_init,
+	.update		= crc32_arch_update,
+	.final		= crc32_final,
+	.digest		= digest_generic_digest,
+	.verify		= digest_generic_verify,
+	.length		= CRC32_DIGEST_SIZE,
+	.ctx_length = sizeof(struct crc32_state),
+};
+
+/**
+ * crc32_digest_register_arch - register the accelerated crc32 digest
+ * @driver_name: name of the implementation behind crc32_le_arch()
+ *
+ * To be called by the architecture code once it has found the CPU to
+ * support the accelerated implementation. It is then preferred over
+ * crc32-generic.
+ */
+int crc32_digest_register_arch(char *driver_name)
+{
+	m_arch.base.driver_name = driver_name;
+
+	return digest_algo_register(&m_arch);
+}
+
 static int crc32_digest_register(void)
 {
 	return digest_algo_register(&m);
@@ -148,6 +148,21 @@ static struct digest_algo *digest_algo_get_by_algo(enum hash_algo algo)
 	return d;
 }
 
+int digest_algo_for_each(int (*fn)(struct digest_algo *algo, void *data),
+			 void *data)
+{
+	struct digest_algo *d;
+	int ret;
+
+	list_for_each_entry(d, &digests, list) {
+		ret = fn(d, data);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 void digest_algo_prints(const char *prefix)
 {
 	struct digest_algo* d;
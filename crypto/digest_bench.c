@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * digest_bench.c - measure the throughput of the registered digests
+ */
+
+#include <common.h>
+#include <clock.h>
+#include <digest.h>
+#include <malloc.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+
+#define DIGEST_BENCH_ALIGN		64
+#define DIGEST_BENCH_DEFAULT_TIME_MS	100
+
+static const unsigned int digest_bench_default_sizes[] = {
+	16, 64, SZ_1K, SZ_16K, SZ_1M,
+};
+
+/* the key has no influence on the speed, so all keyed digests share it */
+static const unsigned char digest_bench_key[32];
+
+struct digest_bench {
+	const char *algo;
+	const unsigned int *sizes;
+	unsigned int num_sizes;
+	unsigned int align;
+	u64 min_ns;
+	void *buf;
+	unsigned int found;
+};
+
+/*
+ * Call digest_digest() in batches of growing size until at least @min_ns
+ * have passed, so that reading the clock doesn't dominate small buffers.
+ */
+static int digest_bench_measure(struct digest *d, const void *buf,
+				unsigned int size, u64 min_ns, u8 *out,
+				u64 *calls, u64 *ns)
+{
+	u64 start, batch = 1, i;
+	int ret;
+
+	*calls = 0;
+	start = get_time_ns();
+
+	do {
+		if (ctrlc())
+			return -EINTR;
+
+		for (i = 0; i < batch; i++) {
+			ret = digest_digest(d, buf, size, out);
+			if (ret)
+				return ret;
+		}
+
+		*calls += batch;
+		*ns = get_time_ns() - start;
+
+		if (batch < SZ_64K)
+			batch <<= 1;
+	} while (*ns < min_ns);
+
+	return 0;
+}
+
+static int digest_bench_algo(struct digest_algo *algo, void *data)
+{
+	struct digest_bench *b = data;
+	const char *driver = algo->base.driver_name;
+	u64 first_ns = 0, last_ns = 0;
+	struct digest *d;
+	unsigned int i;
+	u8 *out;
+	int ret;
+
+	if (b->algo && strcmp(b->algo, algo->base.name) &&
+	    strcmp(b->algo, driver))
+		return 0;
+
+	b->found++;
+
+	d = digest_alloc(driver);
+	if (!d) {
+		printf("%-24s failed to allocate\n", driver);
+		return -ENOMEM;
+	}
+
+	if (digest_is_flags(d, DIGEST_ALGO_NEED_KEY)) {
+		ret = digest_set_key(d, digest_bench_key,
+				     sizeof(digest_bench_key));
+		if (ret)
+			goto out;
+	}
+
+	out = xmalloc(digest_length(d));
+
+	for (i = 0; i < b->num_sizes; i++) {
+		unsigned int size = b->sizes[i];
+		u64 calls, ns, mbps;
+		u32 rem;
+
+		ret = digest_bench_measure(d, b->buf + b->align, size,
+					   b->min_ns, out, &calls, &ns);
+		if (ret)
+			goto out_free;
+
+		ns = div64_u64(ns, calls) ?: 1;
+		if (!i)
+			first_ns = ns;
+		last_ns = ns;
+
+		/* in units of 10 kB/s for two decimal places */
+		mbps = div64_u64((u64)size * 100000, ns);
+		mbps = div_u64_rem(mbps, 100, &rem);
+
+		printf("%-24s %8u %5u %8llu.%02u %10llu\n", driver, size,
+		       b->align, mbps, rem, ns);
+	}
+
+	/*
+	 * The time per call grows linearly with the size, what is left at
+	 * size zero is the cost of init and final plus the call overhead.
+	 */
+	if (b->num_sizes > 1 && b->sizes[0] != b->sizes[b->num_sizes - 1]) {
+		unsigned int s0 = b->sizes[0], s1 = b->sizes[b->num_sizes - 1];
+		s64 overhead = div64_s64(first_ns * s1 - last_ns * s0,
+					 (s64)s1 - s0);
+
+		printf("%-24s overhead %lld ns/call\n", driver,
+		       max_t(s64, overhead, 0));
+	}
+
+	ret = 0;
+out_free:
+	free(out);
+out:
+	digest_free(d);
+	return ret;
+}
+
+/**
+ * digest_bench - measure the throughput of registered digests
+ * @algo: name or driver name of the digests to measure, all if NULL
+ * @params: buffer sizes, alignment and duration, defaults if NULL
+ *
+ * For each digest and each buffer size, this prints the throughput in MB/s
+ * and the time per call to digest_digest(). With more than one size, the
+ * per call overhead is estimated from the smallest and the largest one.
+ * The sizes must be in ascending order.
+ *
+ * Return: 0 on success, negative error code otherwise
+ */
+int digest_bench(const char *algo, const struct digest_bench_params *params)
+{
+	struct digest_bench b = {
+		.algo = algo,
+		.sizes = digest_bench_default_sizes,
+		.num_sizes = ARRAY_SIZE(digest_bench_default_sizes),
+		.min_ns = DIGEST_BENCH_DEFAULT_TIME_MS * MSECOND,
+	};
+	unsigned int i, max_size = 0;
+	int ret;
+
+	if (params) {
+		if (params->num_sizes) {
+			b.sizes = params->sizes;
+			b.num_sizes = params->num_sizes;
+		}
+		if (params->min_time_ms)
+			b.min_ns = (u64)params->min_time_ms * MSECOND;
+		b.align = params->align;
+	}
+
+	for (i = 0; i < b.num_sizes; i++) {
+		if (!b.sizes[i] || (i && b.sizes[i] <= b.sizes[i - 1]))
+			return -EINVAL;
+		max_size = b.sizes[i];
+	}
+
+	b.buf = memalign(DIGEST_BENCH_ALIGN, max_size + b.align);
+	if (!b.buf)
+		return -ENOMEM;
+
+	for (i = 0; i < max_size + b.align; i++)
+		((u8 *)b.buf)[i] = i;
+
+	printf("%-24s %8s %5s %11s %10s\n",
+	       "driver", "size", "align", "MB/s", "ns/call");
+
+	ret = digest_algo_for_each(digest_bench_algo, &b);
+	if (!ret && !b.found)
+		ret = -ENOENT;
+
+	free(b.buf);
+
+	return ret;
+}
+EXPORT_SYMBOL(digest_bench);
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * digest_mb.c - calculate the digests of several buffers at once
+ */
+
+#include <common.h>
+#include <digest.h>
+
+static LIST_HEAD(digests_mb);
+
+int digest_mb_algo_register(struct digest_mb_algo *algo)
+{
+	if (!algo || !algo->base.name || !algo->base.driver_name ||
+	    !algo->digest)
+		return -EINVAL;
+
+	list_add_tail(&algo->list, &digests_mb);
+
+	return 0;
+}
+EXPORT_SYMBOL(digest_mb_algo_register);
+
+static struct digest_mb_algo *digest_mb_algo_get_by_name(const char *name)
+{
+	struct digest_mb_algo *by_name = NULL, *by_driver = NULL, *tmp;
+	int priority = -1;
+
+	list_for_each_entry(tmp, &digests_mb, list) {
+		if (!strcmp(tmp->base.driver_name, name))
+			by_driver = tmp;
+
+		if (strcmp(tmp->base.name, name) ||
+		    tmp->base.priority <= priority)
+			continue;
+
+		by_name = tmp;
+		priority = tmp->base.priority;
+	}
+
+	return by_driver ?: by_name;
+}
+
+static int digest_mb_sequential(struct digest *d, struct digest_mb_req *reqs,
+				unsigned int num)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < num; i++) {
+		ret = digest_init(d);
+		if (!ret)
+			ret = digest_update(d, reqs[i].data, reqs[i].len);
+		if (!ret)
+			ret = digest_final(d, reqs[i].out);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * digest_mb - calculate the digests of several buffers
+ * @name: name or driver name of the digest
+ * @reqs: the buffers and where to store their digests
+ * @num: number of entries in @reqs
+ *
+ * A multi-buffer implementation of @name is used if there is one which is
+ * preferable to the fastest single buffer digest, otherwise the buffers
+ * are hashed one after the other. A multi-buffer driver name selects that
+ * implementation unconditionally. Keyed digests are not supported.
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int digest_mb(const char *name, struct digest_mb_req *reqs, unsigned int num)
+{
+	struct digest_mb_algo *mb;
+	struct digest *d;
+	int ret;
+
+	if (!name || (num && !reqs))
+		return -EINVAL;
+
+	if (!num)
+		return 0;
+
+	mb = digest_mb_algo_get_by_name(name);
+	if (mb && !strcmp(mb->base.driver_name, name))
+		return mb->digest(reqs, num);
+
+	d = digest_alloc(name);
+	if (!d)
+		return mb ? mb->digest(reqs, num) : -ENOENT;
+
+	if (digest_is_flags(d, DIGEST_ALGO_NEED_KEY))
+		ret = -EINVAL;
+	else if (mb && num > 1 && mb->base.priority > d->algo->base.priority)
+		ret = mb->digest(reqs, num);
+	else
+		ret = digest_mb_sequential(d, reqs, num);
+
+	digest_free(d);
+
+	return ret;
+}
+EXPORT_SYMBOL(digest_mb);
@@ -467,7 +467,7 @@ const struct rsa_public_key *rsa_get_key(const char *name)
 	return NULL;
 }
 
-static int rsa_key_add(struct rsa_public_key *key)
+int rsa_key_add(struct rsa_public_key *key)
 {
 	if (rsa_get_key(key->key_name_hint))
 		return -EEXIST;
@@ -477,6 +477,11 @@ static int rsa_key_add(struct rsa_public_key *key)
 	return 0;
 }
 
+void rsa_key_remove(struct rsa_public_key *key)
+{
+	list_del(&key->list);
+}
+
 static struct rsa_public_key *rsa_key_dup(const struct rsa_public_key *key)
 {
 	struct rsa_public_key *new;
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha256_mb.c - lane scheduling for multi-buffer SHA-256 implementations
+ *
+ * The block function of a multi-buffer implementation always processes
+ * the same number of blocks in all of its lanes. The messages are fed
+ * into the lanes in pieces that are contiguous in memory: first the full
+ * blocks of the message itself, then the padded tail, which is assembled
+ * in a buffer of the lane. Whenever a lane finishes its message, it
+ * picks up the next one.
+ */
+
+#include <common.h>
+#include <digest.h>
+#include <malloc.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_mb.h>
+#include <asm/unaligned.h>
+
+struct sha256_mb_lane {
+	struct digest_mb_req *req;
+	const u8 *data;			/* next block to process */
+	unsigned int blocks;		/* message blocks left */
+	unsigned int tail_blocks;	/* tail blocks left, after those */
+	u8 tail[2 * SHA256_BLOCK_SIZE];
+};
+
+static const u32 sha256_mb_iv[] = {
+	SHA256_H0, SHA256_H1, SHA256_H2, SHA256_H3,
+	SHA256_H4, SHA256_H5, SHA256_H6, SHA256_H7,
+};
+
+static void sha256_mb_lane_start(struct sha256_mb_lane *lane,
+				 struct sha256_mb_state *st, unsigned int l,
+				 struct digest_mb_req *req)
+{
+	unsigned int partial = req->len % SHA256_BLOCK_SIZE;
+	int i;
+
+	lane->req = req;
+	lane->blocks = req->len / SHA256_BLOCK_SIZE;
+	lane->data = lane->blocks ? req->data : lane->tail;
+	lane->tail_blocks = partial < SHA256_BLOCK_SIZE - 8 ? 1 : 2;
+
+	memset(lane->tail, 0, sizeof(lane->tail));
+	memcpy(lane->tail, req->data + req->len - partial, partial);
+	lane->tail[partial] = 0x80;
+	put_unaligned_be64((u64)req->len << 3, lane->tail +
+			   lane->tail_blocks * SHA256_BLOCK_SIZE - 8);
+
+	for (i = 0; i < ARRAY_SIZE(sha256_mb_iv); i++)
+		st->state[i][l] = sha256_mb_iv[i];
+}
+
+/* how many blocks are contiguous at lane->data */
+static unsigned int sha256_mb_lane_blocks(struct sha256_mb_lane *lane)
+{
+	return lane->blocks ?: lane->tail_blocks;
+}
+
+/* returns true if the message of the lane is complete */
+static bool sha256_mb_lane_advance(struct sha256_mb_lane *lane,
+				   unsigned int blocks)
+{
+	lane->data += blocks * SHA256_BLOCK_SIZE;
+
+	if (lane->blocks) {
+		lane->blocks -= blocks;
+		if (!lane->blocks)
+			lane->data = lane->tail;
+		return false;
+	}
+
+	lane->tail_blocks -= blocks;
+
+	return !lane->tail_blocks;
+}
+
+static void sha256_mb_lane_finish(struct sha256_mb_lane *lane,
+				  struct sha256_mb_state *st, unsigned int l)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sha256_mb_iv); i++)
+		put_unaligned_be32(st->state[i][l], lane->req->out + i * 4);
+
+	lane->req = NULL;
+}
+
+/*
+ * With only one message left, running all lanes is a waste. Continue
+ * with the single buffer block function instead.
+ */
+static void sha256_mb_lane_finish_single(struct sha256_mb_lane *lane,
+					 struct sha256_mb_state *st,
+					 unsigned int l,
+					 sha256_block_fn *block_fn)
+{
+	struct sha256_state sst;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sha256_mb_iv); i++)
+		sst.state[i] = st->state[i][l];
+
+	if (lane->blocks)
+		block_fn(&sst, lane->data, lane->blocks);
+	block_fn(&sst, lane->blocks ? lane->tail : lane->data,
+		 lane->tail_blocks);
+
+	for (i = 0; i < ARRAY_SIZE(sha256_mb_iv); i++)
+		st->state[i][l] = sst.state[i];
+
+	sha256_mb_lane_finish(lane, st, l);
+}
+
+/**
+ * sha256_mb_digest - calculate SHA-256 digests of several buffers at once
+ * @reqs: the buffers and where to store their digests
+ * @num: number of entries in @reqs
+ * @lanes: number of lanes of @mb_fn, at most SHA256_MB_MAX_LANES
+ * @mb_fn: multi-buffer block function
+ * @block_fn: single buffer block function to finish the last message
+ *            with, may be NULL
+ *
+ * Return: 0 for success, negative error code otherwise
+ */
+int sha256_mb_digest(struct digest_mb_req *reqs, unsigned int num,
+		     unsigned int lanes, sha256_mb_block_fn *mb_fn,
+		     sha256_block_fn *block_fn)
+{
+	const u8 *data[SHA256_MB_MAX_LANES];
+	struct sha256_mb_lane *lane;
+	struct sha256_mb_state *st;
+	unsigned int next = 0, active = 0, l;
+
+	if (!lanes || lanes > SHA256_MB_MAX_LANES)
+		return -EINVAL;
+
+	lane = calloc(lanes, sizeof(*lane));
+	st = calloc(1, sizeof(*st));
+	if (!lane || !st) {
+		free(lane);
+		free(st);
+		return -ENOMEM;
+	}
+
+	while (1) {
+		unsigned int blocks = UINT_MAX, first = 0;
+
+		for (l = 0; l < lanes && next < num; l++) {
+			if (lane[l].req)
+				continue;
+
+			sha256_mb_lane_start(&lane[l], st, l, &reqs[next++]);
+			active++;
+		}
+
+		if (!active)
+			break;
+
+		for (l = 0; l < lanes; l++) {
+			if (!lane[l].req)
+				continue;
+
+			if (active == 1 && next == num && block_fn) {
+				sha256_mb_lane_finish_single(&lane[l], st, l,
+							     block_fn);
+				active = 0;
+				break;
+			}
+
+			data[l] = lane[l].data;
+			blocks = min(blocks, sha256_mb_lane_blocks(&lane[l]));
+			first = l;
+		}
+
+		if (!active)
+			break;
+
+		/* idle lanes just hash along with one of the others */
+		for (l = 0; l < SHA256_MB_MAX_LANES; l++)
+			if (l >= lanes || !lane[l].req)
+				data[l] = data[first];
+
+		mb_fn(st, data, blocks);
+
+		for (l = 0; l < lanes; l++) {
+			if (!lane[l].req ||
+			    !sha256_mb_lane_advance(&lane[l], blocks))
+				continue;
+
+			sha256_mb_lane_finish(&lane[l], st, l);
+			active--;
+		}
+	}
+
+	free(lane);
+	free(st);
+
+	return 0;
+}
+EXPORT_SYMBOL(sha256_mb_digest);
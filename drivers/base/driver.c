@@ -14,6 +14,7 @@
 
 #include <common.h>
 #include <command.h>
+#include <boot-profile.h>
 #include <deep-probe.h>
 #include <driver.h>
 #include <malloc.h>
@@ -118,6 +119,7 @@ static void dev_report_permanent_probe_deferral(struct device *dev)
 int device_probe(struct device *dev)
 {
 	static int depth = 0;
+	struct boot_profile_event *ev;
 	int ret;
 
 	ret = of_feature_controller_check(dev->of_node);
@@ -137,6 +139,8 @@ int device_probe(struct device *dev)
 
 	list_add(&dev->active, &active_device_list);
 
+	ev = boot_profile_start(BOOT_PROFILE_PROBE, dev_name(dev), NULL);
+
 	if (dev->bus->probe)
 		ret = dev->bus->probe(dev);
 	else if (dev->driver->probe)
@@ -144,6 +148,8 @@ int device_probe(struct device *dev)
 	else
 		ret = 0;
 
+	boot_profile_end(ev, ret);
+
 	depth--;
 
 	switch (ret) {
@@ -372,16 +378,23 @@ EXPORT_SYMBOL(free_device);
  */
 static int device_probe_deferred(void)
 {
+	struct boot_profile_event *ev;
 	struct device *dev, *tmp;
 	struct driver *drv;
 	bool success;
+	int round = 0;
 
 	do {
+		char name[16];
+
 		success = false;
 
 		if (list_empty(&deferred))
 			return 0;
 
+		snprintf(name, sizeof(name), "round %d", ++round);
+		ev = boot_profile_start(BOOT_PROFILE_DEFERRED, name, NULL);
+
 		list_for_each_entry_safe(dev, tmp, &deferred, active) {
 			list_del(&dev->active);
 			INIT_LIST_HEAD(&dev->active);
@@ -394,6 +407,8 @@ static int device_probe_deferred(void)
 				break;
 			}
 		}
+
+		boot_profile_end(ev, 0);
 	} while (success);
 
 	list_for_each_entry(dev, &deferred, active)
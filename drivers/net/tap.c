@@ -26,17 +26,29 @@ static int tap_eth_send(struct eth_device *edev, void *packet, int length)
 	return 0;
 }
 
-static int tap_eth_rx(struct eth_device *edev)
+static int tap_eth_rx(struct eth_device *edev, int budget)
 {
 	struct tap_priv *priv = edev->priv;
-	int length;
+	int length, received = 0;
 
-	length = linux_read_nonblock(priv->fd, priv->rx_buf, PKTSIZE);
+	/* the file descriptor is non-blocking, read until the queue is empty */
+	while (received < budget) {
+		length = linux_read(priv->fd, priv->rx_buf, PKTSIZE + 1);
+		if (length <= 0)
+			break;
+
+		received++;
+
+		/* read() truncates frames that do not fit, don't pass them on */
+		if (length > PKTSIZE) {
+			edev->rx_dropped++;
+			continue;
+		}
 
-	if (length > 0)
 		net_receive(edev, priv->rx_buf, length);
+	}
 
-	return 0;
+	return received;
 }
 
 static int tap_eth_open(struct eth_device *edev)
@@ -74,7 +86,7 @@ static int tap_probe(struct device *dev)
 		goto out;
 	}
 
-	priv->rx_buf = xmalloc(PKTSIZE);
+	priv->rx_buf = xmalloc(PKTSIZE + 1);
 
 	edev = xzalloc(sizeof(struct eth_device));
 	edev->priv = priv;
@@ -83,7 +95,7 @@ static int tap_probe(struct device *dev)
 	edev->init = tap_eth_open;
 	edev->open = tap_eth_open;
 	edev->send = tap_eth_send;
-	edev->recv = tap_eth_rx;
+	edev->recv_batch = tap_eth_rx;
 	edev->halt = tap_eth_halt;
 	edev->get_ethaddr = tap_get_ethaddr;
 	edev->set_ethaddr = tap_set_ethaddr;
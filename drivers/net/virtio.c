@@ -7,14 +7,15 @@
 #include <common.h>
 #include <driver.h>
 #include <malloc.h>
+#include <dma.h>
 #include <net.h>
 #include <init.h>
 #include <linux/virtio.h>
 #include <linux/virtio_ring.h>
 #include <uapi/linux/virtio_net.h>
 
-/* Amount of buffers to keep in the RX virtqueue */
-#define VIRTIO_NET_NUM_RX_BUFS	32
+/* Amount of buffers to keep in the RX virtqueue, limited by the queue size */
+#define VIRTIO_NET_NUM_RX_BUFS	128
 
 /*
  * This value comes from the VirtIO spec: 1500 for maximum packet size,
@@ -31,7 +32,6 @@ struct virtio_net_priv {
 		};
 	};
 
-	char rx_buff[VIRTIO_NET_NUM_RX_BUFS][VIRTIO_NET_RX_BUF_SIZE];
 	bool rx_running;
 	int net_hdr_len;
 	struct eth_device edev;
@@ -55,8 +55,8 @@ static int virtio_net_start(struct eth_device *edev)
 		sg.length = VIRTIO_NET_RX_BUF_SIZE;
 
 		/* setup the receive buffer address */
-		for (i = 0; i < VIRTIO_NET_NUM_RX_BUFS; i++) {
-			sg.addr = priv->rx_buff[i];
+		for (i = 0; i < edev->rx_pool_num; i++) {
+			sg.addr = eth_rx_pool_buf(edev, i);
 			virtqueue_add(priv->rx_vq, sgs, 0, 1);
 		}
 
@@ -101,29 +101,37 @@ static int virtio_net_send(struct eth_device *edev, void *packet, int length)
 	return 0;
 }
 
-static int virtio_net_recv(struct eth_device *edev)
+static int virtio_net_recv(struct eth_device *edev, int budget)
 {
 	struct virtio_net_priv *priv = to_priv(edev);
 	struct virtio_sg sg;
 	struct virtio_sg *sgs[] = { &sg };
 	unsigned int len;
-	void *buf;
-
-	sg.addr = virtqueue_get_buf(priv->rx_vq, &len);
-	if (!sg.addr)
-		return -EAGAIN;
+	int received = 0;
 
 	sg.length = VIRTIO_NET_RX_BUF_SIZE;
 
-	buf = sg.addr + priv->net_hdr_len;
-	len -= priv->net_hdr_len;
+	while (received < budget) {
+		sg.addr = virtqueue_get_buf(priv->rx_vq, &len);
+		if (!sg.addr)
+			break;
+
+		if (len > priv->net_hdr_len)
+			net_receive(edev, sg.addr + priv->net_hdr_len,
+				    len - priv->net_hdr_len);
+		else
+			edev->rx_dropped++;
 
-	net_receive(edev, buf, len);
+		/* Put the buffer back to the rx ring */
+		virtqueue_add(priv->rx_vq, sgs, 0, 1);
+		received++;
+	}
 
-	/* Put the buffer back to the rx ring */
-	virtqueue_add(priv->rx_vq, sgs, 0, 1);
+	/* make the returned buffers known to the device once per batch */
+	if (received)
+		virtqueue_kick(priv->rx_vq);
 
-	return 0;
+	return received;
 }
 
 static void virtio_net_stop(struct eth_device *dev)
@@ -194,14 +202,23 @@ static int virtio_net_probe(struct virtio_device *vdev)
 	edev->priv = priv;
 	edev->parent = &vdev->dev;
 
+	ret = eth_rx_pool_alloc(edev, min_t(unsigned int, VIRTIO_NET_NUM_RX_BUFS,
+					    virtqueue_get_vring_size(priv->rx_vq)));
+	if (ret)
+		return ret;
+
 	edev->open = virtio_net_start;
 	edev->send = virtio_net_send;
-	edev->recv = virtio_net_recv;
+	edev->recv_batch = virtio_net_recv;
 	edev->halt = virtio_net_stop;
 	edev->get_ethaddr = virtio_net_read_rom_hwaddr;
 	edev->set_ethaddr = virtio_net_write_hwaddr;
 
-	return eth_register(edev);
+	ret = eth_register(edev);
+	if (ret)
+		dma_free(edev->rx_pool);
+
+	return ret;
 }
 
 static void virtio_net_remove(struct virtio_device *vdev)
@@ -21,6 +21,7 @@
 #include <linux/clk.h>
 #include <linux/ctype.h>
 #include <linux/err.h>
+#include <linux/hash.h>
 
 static struct device_node *root_node;
 
@@ -74,6 +75,28 @@ static inline struct device_node *of_next_node(struct device_node *node)
 #define of_tree_for_each_node_from(node, from) \
 	for (node = of_next_node(from); node; node = of_next_node(node))
 
+/*
+ * All nodes with a phandle, of all trees, hashed by their phandle. Nodes are
+ * added and removed by of_node_set_phandle().
+ */
+#define OF_PHANDLE_HASH_BITS	8
+
+static struct hlist_head of_phandle_hash[1 << OF_PHANDLE_HASH_BITS];
+
+/* largest phandle ever assigned to a node */
+static phandle of_phandle_max;
+
+/*
+ * Cache of recent path lookups. Entries are checked against the full name of
+ * the node on use and are removed when one of their nodes is deleted.
+ */
+#define OF_PATH_CACHE_BITS	6
+
+static struct of_path_cache_entry {
+	const struct device_node *from;
+	struct device_node *np;
+} of_path_cache[1 << OF_PATH_CACHE_BITS];
+
 /**
  * struct alias_prop - Alias property in 'aliases' node
  * @link:	List node to link the structure in aliases_lookup list
@@ -344,6 +367,34 @@ struct device_node *of_find_node_by_alias(struct device_node *root, const char *
 }
 EXPORT_SYMBOL_GPL(of_find_node_by_alias);
 
+static struct hlist_head *of_phandle_bucket(phandle phandle)
+{
+	return &of_phandle_hash[hash_32(phandle, OF_PHANDLE_HASH_BITS)];
+}
+
+/*
+ * of_node_set_phandle - set the phandle of a node
+ * @node:    The node
+ * @phandle: The new phandle, 0 to remove it
+ *
+ * This only updates the phandle used for lookups, the "phandle" property
+ * is left alone.
+ */
+void of_node_set_phandle(struct device_node *node, phandle phandle)
+{
+	hlist_del_init(&node->phandle_hash);
+
+	node->phandle = phandle;
+	if (!phandle)
+		return;
+
+	hlist_add_head(&node->phandle_hash, of_phandle_bucket(phandle));
+
+	if (phandle > of_phandle_max)
+		of_phandle_max = phandle;
+}
+EXPORT_SYMBOL(of_node_set_phandle);
+
 /*
  * of_find_node_by_phandle_from - Find a node given a phandle from given
  * root node.
@@ -356,8 +407,15 @@ struct device_node *of_find_node_by_phandle_from(phandle phandle,
 {
 	struct device_node *node;
 
-	of_tree_for_each_node_from(node, root)
-		if (node->phandle == phandle)
+	if (!root)
+		root = root_node;
+	if (!root || !phandle)
+		return NULL;
+
+	root = of_find_root_node(root);
+
+	hlist_for_each_entry(node, of_phandle_bucket(phandle), phandle_hash)
+		if (node->phandle == phandle && of_find_root_node(node) == root)
 			return node;
 
 	return NULL;
@@ -403,18 +461,14 @@ EXPORT_SYMBOL(of_get_tree_max_phandle);
 phandle of_node_create_phandle(struct device_node *node)
 {
 	phandle p;
-	struct device_node *root;
 
 	if (node->phandle)
 		return node->phandle;
 
-	root = of_find_root_node(node);
-
-	p = of_get_tree_max_phandle(root) + 1;
+	/* larger than any phandle in any tree, so unused in this one */
+	of_node_set_phandle(node, of_phandle_max + 1);
 
-	node->phandle = p;
-
-	p = cpu_to_be32(p);
+	p = cpu_to_be32(node->phandle);
 
 	of_set_property(node, "phandle", &p, sizeof(p), 1);
 
@@ -1778,9 +1832,49 @@ EXPORT_SYMBOL(of_machine_is_compatible);
  *
  *	Returns a pointer to the node found or NULL.
  */
+static struct of_path_cache_entry *of_path_cache_entry(const struct device_node *from,
+							const char *path)
+{
+	u32 hash = hash_ptr(from, 32);
+
+	while (*path)
+		hash = hash * 31 + tolower(*path++);
+
+	return &of_path_cache[hash_32(hash, OF_PATH_CACHE_BITS)];
+}
+
+static struct device_node *of_path_cache_lookup(struct of_path_cache_entry *e,
+						const struct device_node *from,
+						const char *path)
+{
+	size_t len;
+
+	if (!e->np || e->from != from)
+		return NULL;
+
+	/* the full name of a node is that of its parent plus its name */
+	len = strlen(from->full_name);
+	if (strncasecmp(e->np->full_name, from->full_name, len) ||
+	    strcasecmp(e->np->full_name + len, path))
+		return NULL;
+
+	return e->np;
+}
+
+static void of_path_cache_forget(const struct device_node *node)
+{
+	struct of_path_cache_entry *e;
+
+	for (e = of_path_cache; e < of_path_cache + ARRAY_SIZE(of_path_cache); e++)
+		if (e->from == node || e->np == node)
+			e->from = e->np = NULL;
+}
+
 struct device_node *of_find_node_by_path_from(struct device_node *from,
 					const char *path)
 {
+	struct of_path_cache_entry *e;
+	struct device_node *np;
 	char *slash, *p, *freep;
 
 	if (!from)
@@ -1789,6 +1883,12 @@ struct device_node *of_find_node_by_path_from(struct device_node *from,
 	if (!from || !path || *path != '/')
 		return NULL;
 
+	e = of_path_cache_entry(from, path);
+	np = of_path_cache_lookup(e, from, path);
+	if (np)
+		return np;
+
+	np = from;
 	path++;
 
 	freep = p = xstrdup(path);
@@ -1801,8 +1901,8 @@ struct device_node *of_find_node_by_path_from(struct device_node *from,
 		if (slash)
 			*slash = 0;
 
-		from = of_get_child_by_name(from, p);
-		if (!from)
+		np = of_get_child_by_name(np, p);
+		if (!np)
 			goto out;
 
 		if (!slash)
@@ -1813,7 +1913,12 @@ struct device_node *of_find_node_by_path_from(struct device_node *from,
 out:
 	free(freep);
 
-	return from;
+	if (np) {
+		e->from = from;
+		e->np = np;
+	}
+
+	return np;
 }
 EXPORT_SYMBOL(of_find_node_by_path_from);
 
@@ -1955,7 +2060,10 @@ int barebox_register_fdt(const void *dtb)
 	if (root_node)
 		return -EBUSY;
 
-	root = of_unflatten_dtb(dtb, INT_MAX);
+	if (IS_ENABLED(CONFIG_OF_BAREBOX_DTB_CONST))
+		root = of_unflatten_dtb_const(dtb, INT_MAX);
+	else
+		root = of_unflatten_dtb(dtb, INT_MAX);
 	if (IS_ERR(root)) {
 		pr_err("Cannot unflatten dtb: %pe\n", root);
 		return PTR_ERR(root);
@@ -2391,14 +2499,16 @@ struct device_node *of_new_node(struct device_node *parent, const char *name)
 	INIT_LIST_HEAD(&node->children);
 	INIT_LIST_HEAD(&node->properties);
 
+	/* the name is the last component of the full name */
 	if (parent) {
-		node->name = xstrdup(name);
 		node->full_name = basprintf("%pOF/%s",
 					      node->parent, name);
+		node->name = node->full_name + strlen(node->full_name) -
+			     strlen(name);
 		list_add(&node->list, &parent->list);
 	} else {
-		node->name = xstrdup("");
 		node->full_name = xstrdup("");
+		node->name = node->full_name;
 		INIT_LIST_HEAD(&node->list);
 	}
 
@@ -2473,6 +2583,27 @@ struct property *of_new_property_const(struct device_node *node, const char *nam
 	return prop;
 }
 
+/*
+ * Like of_new_property_const(), but @name is used directly as well and must
+ * stay valid as long as the property has this name.
+ */
+struct property *__of_new_property_const(struct device_node *node,
+					 const char *name,
+					 const void *data, int len)
+{
+	struct property *prop;
+
+	prop = xzalloc(sizeof(*prop));
+	prop->name = (char *)name;
+	prop->name_const = true;
+	prop->length = len;
+	prop->value_const = data;
+
+	list_add_tail(&prop->list, &node->properties);
+
+	return prop;
+}
+
 void of_delete_property(struct property *pp)
 {
 	if (!pp)
@@ -2480,7 +2611,8 @@ void of_delete_property(struct property *pp)
 
 	list_del(&pp->list);
 
-	free(pp->name);
+	if (!pp->name_const)
+		free(pp->name);
 	free(pp->value);
 	free(pp);
 }
@@ -2496,8 +2628,10 @@ struct property *of_rename_property(struct device_node *np,
 
 	of_property_write_bool(np, new_name, false);
 
-	free(pp->name);
+	if (!pp->name_const)
+		free(pp->name);
 	pp->name = xstrdup(new_name);
+	pp->name_const = false;
 	return pp;
 }
 
@@ -2839,7 +2973,7 @@ struct device_node *of_copy_node(struct device_node *parent, const struct device
 	struct device_node *np;
 
 	np = of_new_node(parent, other->name);
-	np->phandle = other->phandle;
+	of_node_set_phandle(np, other->phandle);
 
 	of_merge_nodes(np, other);
 
@@ -2878,7 +3012,9 @@ void of_delete_node(struct device_node *node)
 		list_del(&node->list);
 	}
 
-	free(node->name);
+	of_node_set_phandle(node, 0);
+	of_path_cache_forget(node);
+
 	free(node->full_name);
 	free(node);
 }
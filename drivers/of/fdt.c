@@ -260,13 +260,14 @@ static struct device_node *__of_unflatten_dtb(const void *infdt, int size,
 				goto err;
 			}
 
+			/* names are taken from the strings block as well */
 			if (constprops)
-				p = of_new_property_const(node, name, nodep, len);
+				p = __of_new_property_const(node, name, nodep, len);
 			else
 				p = of_new_property(node, name, nodep, len);
 
 			if (!strcmp(name, "phandle") && len == 4)
-				node->phandle = be32_to_cpup(of_property_get_value(p));
+				of_node_set_phandle(node, be32_to_cpup(of_property_get_value(p)));
 
 			dt_struct = dt_struct_advance(&f, dt_struct,
 					sizeof(struct fdt_property) + len);
@@ -316,9 +317,10 @@ struct device_node *of_unflatten_dtb(const void *infdt, int size)
  *
  * Parse a flat device tree binary blob and return a pointer to the unflattened
  * tree. The tree must be freed after use with of_delete_node(). Unlike the
- * above version this function uses the property data directly from the input
- * flattened tree instead of copying the data, thus @infdt must be valid for the
- * whole lifetime of the returned tree. This is normally not what you want, so
+ * above version this function uses the property names and data directly from
+ * the input flattened tree instead of copying them, thus @infdt must be valid
+ * for the whole lifetime of the returned tree. Properties are copied when they
+ * are modified. This is normally not what you want, so
  * use of_unflatten_dtb() instead.
  */
 struct device_node *of_unflatten_dtb_const(const void *infdt, int size)
@@ -21,7 +21,7 @@ static void adjust_overlay_phandles(struct device_node *overlay, int delta)
 	struct property *prop;
 
 	if (overlay->phandle != 0)
-		overlay->phandle += delta;
+		of_node_set_phandle(overlay, overlay->phandle + delta);
 
 	list_for_each_entry(prop, &overlay->properties, list) {
 		if (of_prop_cmp(prop->name, "phandle") != 0 &&
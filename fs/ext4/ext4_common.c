@@ -33,49 +33,214 @@
 #include <linux/stat.h>
 #include <linux/time.h>
 #include <linux/magic.h>
+#include <linux/log2.h>
 #include <asm/byteorder.h>
 #include <dma.h>
 
 #include "ext4_common.h"
 
-static struct ext4_extent_header *ext4fs_get_extent_block(struct ext2_data *data,
-		char *buf, struct ext4_extent_header *ext_block,
-		uint32_t fileblock, int log2_blksz)
+static int ext4fs_add_extent(struct ext2fs_node *node, uint32_t lblk,
+			     uint32_t len, uint64_t pblk)
 {
+	struct ext4fs_extent_map *map;
+	int num = node->num_extents;
+
+	/* merge with the previous extent if physically contiguous */
+	if (num) {
+		map = &node->extents[num - 1];
+		if (map->lblk + map->len == lblk && map->pblk + map->len == pblk) {
+			map->len += len;
+			return 0;
+		}
+	}
+
+	/* grow the array whenever it is full */
+	if (!num || (num >= 4 && is_power_of_2(num))) {
+		map = realloc(node->extents, max(num * 2, 4) * sizeof(*map));
+		if (!map)
+			return -ENOMEM;
+		node->extents = map;
+	}
+
+	map = &node->extents[num];
+	map->lblk = lblk;
+	map->len = len;
+	map->pblk = pblk;
+
+	node->num_extents++;
+
+	return 0;
+}
+
+static int ext4fs_walk_extents(struct ext2fs_node *node,
+			       struct ext4_extent_header *eh, int level)
+{
+	struct ext_filesystem *fs = node->data->fs;
+	int blksz = EXT2_BLOCK_SIZE(node->data);
+	int log2_blksz = LOG2_EXT2_BLOCK_SIZE(node->data);
+	int entries = le16_to_cpu(eh->eh_entries);
 	struct ext4_extent_idx *index;
-	sector_t block;
-	struct ext_filesystem *fs = data->fs;
-	int blksz = EXT2_BLOCK_SIZE(data);
-	ssize_t ret;
+	char *buf;
+	int ret = 0;
 	int i;
 
-	while (1) {
-		index = (struct ext4_extent_idx *)(ext_block + 1);
+	if (le16_to_cpu(eh->eh_magic) != EXT4_EXT_MAGIC ||
+	    level > EXT4_EXT_MAX_DEPTH)
+		return -EINVAL;
 
-		if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC)
-			return NULL;
+	if (!eh->eh_depth) {
+		struct ext4_extent *extent = (struct ext4_extent *)(eh + 1);
 
-		if (ext_block->eh_depth == 0)
-			return ext_block;
-		i = -1;
-		do {
-			i++;
-			if (i >= le16_to_cpu(ext_block->eh_entries))
-				break;
-		} while (fileblock >= le32_to_cpu(index[i].ei_block));
+		for (i = 0; i < entries; i++) {
+			uint32_t len = le16_to_cpu(extent[i].ee_len);
+			uint64_t start;
 
-		if (--i < 0)
-			return NULL;
+			/* uninitialized extents read as zeroes, like holes */
+			if (len > EXT_INIT_MAX_LEN)
+				continue;
+
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) + le32_to_cpu(extent[i].ee_start_lo);
+
+			ret = ext4fs_add_extent(node,
+					le32_to_cpu(extent[i].ee_block),
+					len, start);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	buf = malloc(blksz);
+	if (!buf)
+		return -ENOMEM;
+
+	index = (struct ext4_extent_idx *)(eh + 1);
+
+	for (i = 0; i < entries; i++) {
+		sector_t block;
 
 		block = le16_to_cpu(index[i].ei_leaf_hi);
 		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
 
 		ret = ext4fs_devread(fs, block << log2_blksz, 0, blksz, buf);
 		if (ret)
-			return NULL;
+			break;
+
+		ret = ext4fs_walk_extents(node,
+				(struct ext4_extent_header *)buf, level + 1);
+		if (ret)
+			break;
+	}
+
+	free(buf);
+
+	return ret;
+}
+
+void ext4fs_free_extents(struct ext2fs_node *node)
+{
+	free(node->extents);
+	node->extents = NULL;
+	node->num_extents = 0;
+	node->extents_read = 0;
+}
+
+/*
+ * Read all leaf extents of an inode once instead of walking the extent
+ * tree for every block. barebox doesn't write to ext4, so the mapping
+ * stays valid for the lifetime of the node.
+ */
+static int ext4fs_read_extents(struct ext2fs_node *node)
+{
+	int ret;
+
+	if (node->extents_read)
+		return 0;
+
+	ret = ext4fs_walk_extents(node,
+			(struct ext4_extent_header *)node->inode.b.blocks.dir_blocks,
+			0);
+	if (ret) {
+		pr_err("invalid extent block\n");
+		ext4fs_free_extents(node);
+		return ret;
+	}
+
+	node->extents_read = 1;
+
+	return 0;
+}
+
+/**
+ * ext4fs_map_blocks - map logical blocks of a file to the disk
+ * @node:	the file
+ * @fileblock:	first logical block
+ * @maxblocks:	maximum number of blocks to map
+ * @blknr:	returns the physical block or 0 for a hole
+ *
+ * Return: the number of blocks starting at @fileblock that are stored
+ * contiguously at @blknr, or are all holes, or a negative error code.
+ */
+long ext4fs_map_blocks(struct ext2fs_node *node, uint32_t fileblock,
+		       uint32_t maxblocks, sector_t *blknr)
+{
+	struct ext4fs_extent_map *map;
+	long count;
+	int lo, hi, ret;
+
+	if (!(le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL)) {
+		long start, blk;
+
+		start = read_allocated_block(node, fileblock);
+		if (start < 0)
+			return start;
+
+		for (count = 1; count < maxblocks; count++) {
+			blk = read_allocated_block(node, fileblock + count);
+			if (blk < 0)
+				return blk;
+			if (blk != (start ? start + count : 0))
+				break;
+		}
+
+		*blknr = start;
+
+		return count;
+	}
+
+	ret = ext4fs_read_extents(node);
+	if (ret)
+		return ret;
+
+	/* find the last extent starting at or before fileblock */
+	lo = 0;
+	hi = node->num_extents;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (node->extents[mid].lblk <= fileblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	map = lo ? &node->extents[lo - 1] : NULL;
+
+	if (map && fileblock - map->lblk < map->len) {
+		*blknr = map->pblk + (fileblock - map->lblk);
+		count = map->len - (fileblock - map->lblk);
+	} else {
+		/* Sparse file, the hole extends to the next extent */
+		*blknr = 0;
+		if (lo < node->num_extents)
+			count = node->extents[lo].lblk - fileblock;
 		else
-			ext_block = (struct ext4_extent_header *)buf;
+			count = maxblocks;
 	}
+
+	return min_t(long, count, maxblocks);
 }
 
 static ssize_t ext4fs_blockgroup(struct ext2_data *data, int group,
@@ -143,11 +308,14 @@ static int ext4fs_get_indir_block(struct ext2fs_node *node,
 
 	ret = ext4fs_devread(fs, blkno, 0, blksz, (void *)indir->data);
 	if (ret) {
+		indir->blkno = -1;
 		dev_err(fs->dev, "** SI ext2fs read block (indir 1)"
 			"failed. **\n");
 		return ret;
 	}
 
+	indir->blkno = blkno;
+
 	return 0;
 }
 
@@ -159,7 +327,6 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	struct ext2_inode *inode = &node->inode;
 	struct ext2_data *data = node->data;
 	int ret;
@@ -169,47 +336,14 @@ long int read_allocated_block(struct ext2fs_node *node, int fileblock)
 	log2_blksz = LOG2_EXT2_BLOCK_SIZE(node->data);
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		long int startblock, endblock;
-		char *buf = zalloc(blksz);
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i;
-
-		if (!buf)
-			return -ENOMEM;
-
-		ext_block = ext4fs_get_extent_block(node->data, buf,
-				(struct ext4_extent_header *)inode->b.blocks.dir_blocks,
-				fileblock, log2_blksz);
-		if (!ext_block) {
-			pr_err("invalid extent block\n");
-			free(buf);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
+		sector_t block;
+		long count;
 
-		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
-			startblock = le32_to_cpu(extent[i].ee_block);
-			endblock = startblock + le16_to_cpu(extent[i].ee_len);
-
-			if (startblock > fileblock) {
-				/* Sparse file */
-				free(buf);
-				return 0;
-			}
+		count = ext4fs_map_blocks(node, fileblock, 1, &block);
+		if (count < 0)
+			return count;
 
-			if (fileblock < endblock) {
-				start = le16_to_cpu(extent[i].ee_start_hi);
-				start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-				free(buf);
-				return (fileblock - startblock) + start;
-			}
-		}
-
-		free(buf);
-		return 0;
+		return block;
 	}
 
 	if (fileblock < INDIRECT_BLOCKS) {
@@ -547,6 +681,10 @@ int ext4fs_mount(struct ext_filesystem *fs)
 		goto fail;
 	}
 
+	fs->data->indir1.blkno = -1;
+	fs->data->indir2.blkno = -1;
+	fs->data->indir3.blkno = -1;
+
 	ret = ext4fs_read_inode(data, 2, data->inode);
 	if (ret)
 		goto fail;
@@ -560,6 +698,7 @@ int ext4fs_mount(struct ext_filesystem *fs)
 
 void ext4fs_umount(struct ext_filesystem *fs)
 {
+	ext4fs_free_extents(&fs->data->diropen);
 	free(fs->data->indir1.data);
 	free(fs->data->indir2.data);
 	free(fs->data->indir3.data);
@@ -26,6 +26,10 @@
 
 #define EXT4_EXTENTS_FL		0x00080000 /* Inode uses extents */
 #define EXT4_EXT_MAGIC			0xf30a
+/* ee_len values above this denote uninitialized extents */
+#define EXT_INIT_MAX_LEN		(1 << 15)
+/* deepest extent tree ext4 creates */
+#define EXT4_EXT_MAX_DEPTH		5
 #define EXT4_FEATURE_RO_COMPAT_GDT_CSUM	0x0010
 #define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
 #define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
@@ -97,5 +101,8 @@ char *ext4fs_read_symlink(struct ext2fs_node *node);
 void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot);
 ssize_t ext4fs_devread(struct ext_filesystem *fs, sector_t sector, int byte_offset, size_t byte_len, char *buf);
 long int read_allocated_block(struct ext2fs_node *node, int fileblock);
+long ext4fs_map_blocks(struct ext2fs_node *node, uint32_t fileblock,
+		       uint32_t maxblocks, sector_t *blknr);
+void ext4fs_free_extents(struct ext2fs_node *node);
 
 #endif
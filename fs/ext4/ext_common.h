@@ -209,17 +209,28 @@ struct ext2_dirent {
 	__u8 filetype;
 };
 
+/* A run of logical blocks stored in contiguous physical blocks */
+struct ext4fs_extent_map {
+	uint32_t lblk;
+	uint32_t len;
+	uint64_t pblk;
+};
+
 struct ext2fs_node {
 	struct inode i;
 	struct ext2_data *data;
 	struct ext2_inode inode;
 	int ino;
 	int inode_read;
+	/* leaf extents of the inode, sorted by logical block */
+	struct ext4fs_extent_map *extents;
+	int num_extents;
+	int extents_read;
 };
 
 struct ext4fs_indir_block {
 	int size;
-	int blkno;
+	sector_t blkno;
 	uint32_t *data;
 };
 
@@ -0,0 +1,487 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * http.c - read-only HTTP filesystem
+ *
+ * Files are fetched with plain HTTP/1.0 GET requests, so the server closes
+ * the connection after each response and no chunked transfer encoding has
+ * to be handled. Seeking reopens the file with a Range request.
+ */
+
+#define pr_fmt(fmt) "http: " fmt
+
+#include <common.h>
+#include <driver.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fs.h>
+#include <init.h>
+#include <malloc.h>
+#include <net.h>
+#include <parseopt.h>
+#include <linux/ctype.h>
+#include <linux/err.h>
+#include <linux/sizes.h>
+#include <linux/stat.h>
+
+#define HTTP_PORT		80
+#define HTTP_HEADER_MAX		4096
+
+struct http_priv {
+	IPaddr_t server;
+	uint16_t port;
+	const char *host;
+};
+
+struct file_priv {
+	struct http_priv *hpriv;
+	struct tcp_sock *sk;
+	char *path;
+	loff_t pos;		/* file position of the next byte from the connection */
+	loff_t remaining;	/* bytes left in the response body, -1 if unknown */
+
+	/* body data received together with the response header */
+	char *buf;
+	size_t buf_start;
+	size_t buf_end;
+};
+
+struct http_response {
+	int status;
+	loff_t content_length;
+};
+
+/* percent-encode everything but unreserved characters and '/' */
+static char *http_escape_path(const char *path)
+{
+	char *escaped, *p;
+
+	p = escaped = xmalloc(strlen(path) * 3 + 1);
+
+	for (; *path; path++) {
+		unsigned char c = *path;
+
+		if (isalnum(c) || strchr("/-._~", c))
+			*p++ = c;
+		else
+			p += sprintf(p, "%%%02X", c);
+	}
+
+	*p = 0;
+
+	return escaped;
+}
+
+static int http_parse_header(struct file_priv *priv, struct http_response *resp)
+{
+	char *line, *next;
+
+	resp->status = 0;
+	resp->content_length = -1;
+
+	for (line = priv->buf; line; line = next) {
+		next = strstr(line, "\r\n");
+		if (next) {
+			*next = 0;
+			next += 2;
+		}
+
+		if (line == priv->buf) {
+			if (strncmp(line, "HTTP/1.", 7) || strlen(line) < 12)
+				return -EPROTO;
+			resp->status = simple_strtoul(line + 9, NULL, 10);
+		} else if (!strncasecmp(line, "Content-Length:", 15)) {
+			resp->content_length = simple_strtoull(skip_spaces(line + 15),
+							       NULL, 10);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Send a request and read the response header. Any part of the body that
+ * has been received along with the header is left in priv->buf.
+ */
+static int http_request(struct file_priv *priv, const char *method, loff_t offset,
+			struct http_response *resp)
+{
+	struct http_priv *hpriv = priv->hpriv;
+	char *path, *req, *end;
+	size_t len = 0;
+	int ret;
+
+	priv->sk = tcp_connect(hpriv->server, hpriv->port);
+	if (IS_ERR(priv->sk)) {
+		ret = PTR_ERR(priv->sk);
+		priv->sk = NULL;
+		return ret;
+	}
+
+	path = http_escape_path(priv->path);
+	if (offset)
+		req = xasprintf("%s %s HTTP/1.0\r\nHost: %s\r\nRange: bytes=%lld-\r\n"
+				"User-Agent: barebox\r\n\r\n",
+				method, path, hpriv->host, offset);
+	else
+		req = xasprintf("%s %s HTTP/1.0\r\nHost: %s\r\n"
+				"User-Agent: barebox\r\n\r\n",
+				method, path, hpriv->host);
+	free(path);
+
+	ret = tcp_send(priv->sk, req, strlen(req));
+	free(req);
+	if (ret < 0)
+		return ret;
+
+	if (!priv->buf)
+		priv->buf = xmalloc(HTTP_HEADER_MAX + 1);
+
+	while (1) {
+		ret = tcp_recv(priv->sk, priv->buf + len, HTTP_HEADER_MAX - len);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EPROTO;
+
+		len += ret;
+		priv->buf[len] = 0;
+
+		end = strstr(priv->buf, "\r\n\r\n");
+		if (end)
+			break;
+
+		if (len == HTTP_HEADER_MAX)
+			return -E2BIG;
+	}
+
+	*end = 0;
+	priv->buf_start = end + 4 - priv->buf;
+	priv->buf_end = len;
+
+	ret = http_parse_header(priv, resp);
+	if (ret)
+		return ret;
+
+	pr_debug("%s %s: status %d, length %lld\n", method, priv->path,
+		 resp->status, resp->content_length);
+
+	switch (resp->status) {
+	case 200 ... 299:
+		return 0;
+	case 301 ... 303:
+	case 307 ... 308:
+		return -EISDIR;
+	case 401:
+	case 403:
+		return -EACCES;
+	case 404:
+	case 410:
+		return -ENOENT;
+	case 416:
+		return -EINVAL;
+	default:
+		return -EIO;
+	}
+}
+
+static void http_disconnect(struct file_priv *priv)
+{
+	tcp_close(priv->sk);
+	priv->sk = NULL;
+	priv->buf_start = priv->buf_end = 0;
+}
+
+static int http_recv(struct file_priv *priv, void *buf, size_t len)
+{
+	size_t now;
+	int ret;
+
+	if (!priv->remaining)
+		return 0;
+
+	if (priv->remaining > 0)
+		len = min_t(loff_t, len, priv->remaining);
+
+	if (priv->buf_start < priv->buf_end) {
+		now = min(len, priv->buf_end - priv->buf_start);
+		memcpy(buf, priv->buf + priv->buf_start, now);
+		priv->buf_start += now;
+		ret = now;
+	} else {
+		ret = tcp_recv(priv->sk, buf, len);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return priv->remaining > 0 ? -EIO : 0;
+	}
+
+	if (priv->remaining > 0)
+		priv->remaining -= ret;
+
+	return ret;
+}
+
+/* (re)start the transfer at @pos */
+static int http_get(struct file_priv *priv, loff_t pos)
+{
+	struct http_response resp;
+	char *skipbuf;
+	int ret;
+
+	if (priv->sk)
+		http_disconnect(priv);
+
+	ret = http_request(priv, "GET", pos, &resp);
+	if (ret)
+		goto err;
+
+	priv->pos = pos;
+	priv->remaining = resp.content_length;
+
+	if (!pos || resp.status == 206)
+		return 0;
+
+	/* server does not support ranges, skip the data up to @pos */
+	priv->pos = 0;
+	skipbuf = xmalloc(SZ_4K);
+
+	while (priv->pos < pos) {
+		ret = http_recv(priv, skipbuf, min_t(loff_t, SZ_4K, pos - priv->pos));
+		if (!ret)
+			ret = -EINVAL;
+		if (ret < 0)
+			break;
+		priv->pos += ret;
+	}
+
+	free(skipbuf);
+
+	if (ret >= 0)
+		return 0;
+err:
+	http_disconnect(priv);
+	return ret;
+}
+
+static struct file_priv *http_file_new(struct device *dev, struct dentry *dentry)
+{
+	struct fs_device *fsdev = dev_to_fs_device(dev);
+	struct file_priv *priv;
+
+	priv = xzalloc(sizeof(*priv));
+	priv->hpriv = dev->priv;
+	priv->path = dpath(dentry, fsdev->vfsmount.mnt_root);
+
+	return priv;
+}
+
+static void http_file_free(struct file_priv *priv)
+{
+	if (priv->sk)
+		http_disconnect(priv);
+
+	free(priv->path);
+	free(priv->buf);
+	free(priv);
+}
+
+static int http_open(struct device *dev, FILE *file, const char *filename)
+{
+	struct file_priv *priv;
+	int ret;
+
+	if ((file->flags & O_ACCMODE) != O_RDONLY)
+		return -EROFS;
+
+	priv = http_file_new(dev, file->dentry);
+
+	ret = http_get(priv, 0);
+	if (ret) {
+		http_file_free(priv);
+		return ret;
+	}
+
+	file->priv = priv;
+
+	return 0;
+}
+
+static int http_close(struct device *dev, FILE *f)
+{
+	http_file_free(f->priv);
+
+	return 0;
+}
+
+static int http_read(struct device *dev, FILE *f, void *buf, size_t insize)
+{
+	struct file_priv *priv = f->priv;
+	size_t outsize = 0;
+	int ret;
+
+	/* a seek happened since the last read or the last request failed */
+	if (!priv->sk || f->pos != priv->pos) {
+		ret = http_get(priv, f->pos);
+		if (ret)
+			return ret;
+	}
+
+	while (insize) {
+		ret = http_recv(priv, buf, insize);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+
+		buf += ret;
+		insize -= ret;
+		outsize += ret;
+		priv->pos += ret;
+	}
+
+	return outsize;
+}
+
+static int http_write(struct device *dev, FILE *f, const void *buf, size_t insize)
+{
+	return -EROFS;
+}
+
+static int http_truncate(struct device *dev, FILE *f, loff_t size)
+{
+	return -EROFS;
+}
+
+static const struct inode_operations http_dir_inode_operations;
+static const struct file_operations http_file_operations;
+
+static struct inode *http_get_inode(struct super_block *sb, umode_t mode)
+{
+	struct inode *inode = new_inode(sb);
+
+	if (!inode)
+		return NULL;
+
+	inode->i_ino = get_next_ino();
+	inode->i_mode = mode;
+
+	switch (mode & S_IFMT) {
+	default:
+		iput(inode);
+		return NULL;
+	case S_IFREG:
+		inode->i_fop = &http_file_operations;
+		break;
+	case S_IFDIR:
+		inode->i_op = &http_dir_inode_operations;
+		inode->i_fop = &simple_dir_operations;
+		inc_nlink(inode);
+		break;
+	}
+
+	return inode;
+}
+
+/*
+ * HTTP has no notion of directories. A path the server redirects to is
+ * taken as a directory, as servers usually redirect "dir" to "dir/".
+ */
+static struct dentry *http_lookup(struct inode *dir, struct dentry *dentry,
+				  unsigned int flags)
+{
+	struct super_block *sb = dir->i_sb;
+	struct fs_device *fsdev = container_of(sb, struct fs_device, sb);
+	struct http_response resp;
+	struct file_priv *priv;
+	struct inode *inode;
+	int ret;
+
+	priv = http_file_new(&fsdev->dev, dentry);
+	ret = http_request(priv, "HEAD", 0, &resp);
+	http_file_free(priv);
+
+	if (ret == -EISDIR) {
+		inode = http_get_inode(sb, S_IFDIR | 0555);
+	} else if (!ret) {
+		inode = http_get_inode(sb, S_IFREG | 0444);
+		if (inode)
+			inode->i_size = resp.content_length >= 0 ?
+					resp.content_length : FILE_SIZE_STREAM;
+	} else {
+		return NULL;
+	}
+
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+
+	d_add(dentry, inode);
+
+	return NULL;
+}
+
+static const struct inode_operations http_dir_inode_operations = {
+	.lookup = http_lookup,
+};
+
+static const struct super_operations http_ops;
+
+static int http_probe(struct device *dev)
+{
+	struct fs_device *fsdev = dev_to_fs_device(dev);
+	struct http_priv *priv = xzalloc(sizeof(struct http_priv));
+	struct super_block *sb = &fsdev->sb;
+	struct inode *inode;
+	int ret;
+
+	dev->priv = priv;
+
+	ret = resolv(fsdev->backingstore, &priv->server);
+	if (ret) {
+		pr_err("Cannot resolve \"%s\": %pe\n", fsdev->backingstore, ERR_PTR(ret));
+		goto err;
+	}
+
+	priv->host = fsdev->backingstore;
+	priv->port = HTTP_PORT;
+	parseopt_hu(fsdev->options, "port", &priv->port);
+
+	sb->s_op = &http_ops;
+	sb->s_d_op = &no_revalidate_d_ops;
+
+	inode = http_get_inode(sb, S_IFDIR | 0555);
+	sb->s_root = d_make_root(inode);
+
+	return 0;
+err:
+	free(priv);
+
+	return ret;
+}
+
+static void http_remove(struct device *dev)
+{
+	struct http_priv *priv = dev->priv;
+
+	free(priv);
+}
+
+static struct fs_driver http_driver = {
+	.open      = http_open,
+	.close     = http_close,
+	.read      = http_read,
+	.write     = http_write,
+	.truncate  = http_truncate,
+	.flags     = 0,
+	.drv = {
+		.probe  = http_probe,
+		.remove = http_remove,
+		.name = "http",
+	}
+};
+
+static int http_init(void)
+{
+	return register_fs_driver(&http_driver);
+}
+coredevice_initcall(http_init);
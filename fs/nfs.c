@@ -54,6 +54,7 @@
 #define NFSPROC3_READLINK	5
 #define NFSPROC3_READ		6
 #define NFSPROC3_READDIR	16
+#define NFSPROC3_FSINFO		19
 
 #define NFS3_FHSIZE      64
 #define NFS3_COOKIEVERFSIZE	8
@@ -121,6 +122,14 @@ struct rpc_reply {
 #define NFS_TIMEOUT	(100 * MSECOND)
 #define NFS_MAX_RESEND	100
 
+/* number of READ calls kept in flight while reading a file */
+#define NFS_READ_WINDOW		8
+/*
+ * largest READ reply that fits into a single unfragmented datagram, larger
+ * replies are possible when the network stack reassembles IP fragments
+ */
+#define NFS_READ_SIZE_MAX	(IS_ENABLED(CONFIG_NET_IP_REASSEMBLY) ? 8192 : 1024)
+
 struct nfs_fh {
 	unsigned short size;
 	unsigned char data[NFS3_FHSIZE];
@@ -143,6 +152,17 @@ struct nfs_priv {
 	uint32_t rpc_id;
 	struct nfs_fh rootfh;
 	struct list_head packets;
+	/* data size of READ calls */
+	uint32_t rsize;
+};
+
+struct nfs_read_slot {
+	uint32_t xid;
+	uint64_t offset;
+	uint32_t count;
+	uint64_t sent;
+	int tries;
+	struct packet *reply;
 };
 
 struct file_priv {
@@ -150,6 +170,13 @@ struct file_priv {
 	void *buf;
 	struct nfs_priv *npriv;
 	struct nfs_fh fh;
+	uint64_t size;
+	/* READ calls in flight, oldest first */
+	struct nfs_read_slot slots[NFS_READ_WINDOW];
+	int first_slot;
+	int nslots;
+	/* file offset of the next READ call */
+	uint64_t next_offset;
 };
 
 struct nfs_inode {
@@ -457,29 +484,21 @@ static void nfs_free_packet(struct packet *packet)
 }
 
 /*
- * rpc_req - synchronous RPC request
+ * rpc_send - send an RPC call, the reply is received by nfs_handler()
  */
-static struct packet *rpc_req(struct nfs_priv *npriv, int rpc_prog,
-			      int rpc_proc, uint32_t *data, int datalen)
+static int rpc_send(struct nfs_priv *npriv, uint32_t rpc_id, int rpc_prog,
+		    int rpc_proc, uint32_t *data, int datalen)
 {
 	struct rpc_call pkt;
 	unsigned short dport;
-	int ret;
 	unsigned char *payload = net_udp_get_payload(npriv->con);
-	int nfserr;
-	int tries = 0;
-	struct packet *packet;
 
-	npriv->rpc_id++;
-
-	pkt.id = hton32(npriv->rpc_id);
+	pkt.id = hton32(rpc_id);
 	pkt.type = hton32(MSG_CALL);
 	pkt.rpcvers = hton32(2);	/* use RPC version 2 */
 	pkt.prog = hton32(rpc_prog);
 	pkt.proc = hton32(rpc_proc);
 
-	debug("%s: prog: %d, proc: %d\n", __func__, rpc_prog, rpc_proc);
-
 	if (rpc_prog == PROG_PORTMAP) {
 		dport = SUNRPC_PORT;
 		pkt.vers = hton32(2);
@@ -496,11 +515,29 @@ static struct packet *rpc_req(struct nfs_priv *npriv, int rpc_prog,
 
 	npriv->con->udp->uh_dport = hton16(dport);
 
+	return net_udp_send(npriv->con,
+			sizeof(pkt) + datalen * sizeof(uint32_t));
+}
+
+/*
+ * rpc_req - synchronous RPC request
+ */
+static struct packet *rpc_req(struct nfs_priv *npriv, int rpc_prog,
+			      int rpc_proc, uint32_t *data, int datalen)
+{
+	int ret;
+	int nfserr;
+	int tries = 0;
+	struct packet *packet;
+
+	npriv->rpc_id++;
+
+	debug("%s: prog: %d, proc: %d\n", __func__, rpc_prog, rpc_proc);
+
 	nfs_timer_start = get_time_ns();
 
 again:
-	ret = net_udp_send(npriv->con,
-			sizeof(pkt) + datalen * sizeof(uint32_t));
+	ret = rpc_send(npriv, npriv->rpc_id, rpc_prog, rpc_proc, data, datalen);
 	if (ret) {
 		if (is_timeout(nfs_timer_start, NFS_TIMEOUT)) {
 			tries++;
@@ -767,6 +804,89 @@ static int nfs_mount_req(struct nfs_priv *npriv)
 	return 0;
 }
 
+/*
+ * nfs_fsinfo_req - Get the transfer sizes supported by the server
+ */
+static int nfs_fsinfo_req(struct nfs_priv *npriv, uint32_t *rtmax,
+			  uint32_t *rtpref)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
+	struct packet *nfs_packet;
+
+	/*
+	 * struct FSINFO3args {
+	 * 	nfs_fh3 fsroot;
+	 * };
+	 *
+	 * struct FSINFO3resok {
+	 * 	post_op_attr obj_attributes;
+	 * 	uint32 rtmax;
+	 * 	uint32 rtpref;
+	 * 	uint32 rtmult;
+	 * 	...
+	 * };
+	 */
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = nfs_add_fh3(p, &npriv->rootfh);
+
+	len = p - &(data[0]);
+
+	nfs_packet = rpc_req(npriv, PROG_NFS, NFSPROC3_FSINFO, data, len);
+	if (IS_ERR(nfs_packet))
+		return PTR_ERR(nfs_packet);
+
+	/* skip over status, rpc_req() has checked it */
+	p = (void *)nfs_packet->data + sizeof(struct rpc_reply) + 4;
+	p = nfs_read_post_op_attr(p, NULL);
+
+	if ((void *)(p + 2) > (void *)nfs_packet->data + nfs_packet->len) {
+		nfs_free_packet(nfs_packet);
+		return -EIO;
+	}
+
+	*rtmax = ntoh32(net_read_uint32(p));
+	*rtpref = ntoh32(net_read_uint32(p + 1));
+
+	nfs_free_packet(nfs_packet);
+
+	return 0;
+}
+
+/*
+ * nfs_set_rsize - Choose the READ size from what server and network allow
+ */
+static void nfs_set_rsize(struct nfs_priv *npriv, struct fs_device *fsdev)
+{
+	unsigned short rsize = 0;
+	uint32_t rtmax, rtpref;
+	int ret;
+
+	npriv->rsize = NFS_READ_SIZE_MAX;
+
+	ret = nfs_fsinfo_req(npriv, &rtmax, &rtpref);
+	if (ret) {
+		pr_warn("FSINFO failed: %pe, using rsize %u\n", ERR_PTR(ret),
+			npriv->rsize);
+	} else {
+		if (rtpref)
+			npriv->rsize = min(npriv->rsize, rtpref);
+		if (rtmax)
+			npriv->rsize = min(npriv->rsize, rtmax);
+	}
+
+	parseopt_hu(fsdev->options, "rsize", &rsize);
+	if (rsize)
+		npriv->rsize = min_t(uint32_t, npriv->rsize, rsize);
+
+	npriv->rsize = max_t(uint32_t, npriv->rsize & ~3, 4);
+
+	debug("rsize: %u\n", npriv->rsize);
+}
+
 /*
  * nfs_umountall_req - Unmount all our NFS Filesystems on the Server
  */
@@ -969,16 +1089,12 @@ static void *nfs_readdirattr_req(struct nfs_priv *npriv, struct nfs_dir *dir)
 }
 
 /*
- * nfs_read_req - Read File on NFS Server
+ * nfs_read_send - send the READ call of a slot
  */
-static int nfs_read_req(struct file_priv *priv, uint64_t offset,
-		uint32_t readlen)
+static void nfs_read_send(struct file_priv *priv, struct nfs_read_slot *slot)
 {
 	uint32_t data[1024];
-	uint32_t *p, status;
-	int len, ret;
-	struct packet *nfs_packet;
-	uint32_t rlen, eof;
+	uint32_t *p;
 
 	/*
 	 * struct READ3args {
@@ -986,7 +1102,139 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 * 	offset3 offset;
 	 * 	count3 count;
 	 * };
-	 *
+	 */
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = nfs_add_fh3(p, &priv->fh);
+	p = nfs_add_uint64(p, slot->offset);
+	p = nfs_add_uint32(p, slot->count);
+
+	/* a failed send is retried like a lost reply */
+	rpc_send(priv->npriv, slot->xid, PROG_NFS, NFSPROC3_READ, data,
+		 p - &(data[0]));
+
+	slot->sent = get_time_ns();
+}
+
+static struct nfs_read_slot *nfs_read_slot(struct file_priv *priv, int i)
+{
+	return &priv->slots[(priv->first_slot + i) % NFS_READ_WINDOW];
+}
+
+static void nfs_read_cancel(struct file_priv *priv)
+{
+	int i;
+
+	for (i = 0; i < priv->nslots; i++)
+		free(nfs_read_slot(priv, i)->reply);
+
+	priv->nslots = 0;
+}
+
+/*
+ * Keep NFS_READ_WINDOW READ calls for the following file data in flight,
+ * so that the transfer isn't bound by the round trip time.
+ */
+static void nfs_read_fill_window(struct file_priv *priv)
+{
+	struct nfs_priv *npriv = priv->npriv;
+	struct nfs_read_slot *slot;
+
+	while (priv->nslots < NFS_READ_WINDOW &&
+	       (!priv->nslots || priv->next_offset < priv->size)) {
+		slot = nfs_read_slot(priv, priv->nslots);
+
+		slot->xid = ++npriv->rpc_id;
+		slot->offset = priv->next_offset;
+		slot->count = npriv->rsize;
+		if (priv->next_offset < priv->size)
+			slot->count = min_t(uint64_t, slot->count,
+					    priv->size - priv->next_offset);
+		slot->tries = 0;
+		slot->reply = NULL;
+
+		nfs_read_send(priv, slot);
+
+		priv->next_offset += slot->count;
+		priv->nslots++;
+	}
+}
+
+/*
+ * Assign received replies to the READ calls in flight. Replies may
+ * arrive in any order, replies to calls we no longer wait for are
+ * dropped.
+ */
+static void nfs_read_receive(struct file_priv *priv)
+{
+	struct nfs_priv *npriv = priv->npriv;
+	struct packet *packet, *tmp;
+	int i;
+
+	list_for_each_entry_safe(packet, tmp, &npriv->packets, list) {
+		struct nfs_read_slot *slot = NULL;
+		uint32_t xid;
+
+		list_del(&packet->list);
+
+		if (packet->len < sizeof(struct rpc_reply)) {
+			free(packet);
+			continue;
+		}
+
+		xid = ntoh32(net_read_uint32(packet->data));
+
+		for (i = 0; i < priv->nslots; i++) {
+			slot = nfs_read_slot(priv, i);
+			if (slot->xid == xid && !slot->reply)
+				break;
+		}
+
+		if (i < priv->nslots)
+			slot->reply = packet;
+		else
+			free(packet);
+	}
+}
+
+static int nfs_read_wait(struct file_priv *priv, struct nfs_read_slot *head)
+{
+	struct nfs_read_slot *slot;
+	int i;
+
+	while (1) {
+		nfs_read_receive(priv);
+		if (head->reply)
+			return 0;
+
+		for (i = 0; i < priv->nslots; i++) {
+			slot = nfs_read_slot(priv, i);
+
+			if (slot->reply || !is_timeout(slot->sent, NFS_TIMEOUT))
+				continue;
+
+			if (++slot->tries == NFS_MAX_RESEND)
+				return -ETIMEDOUT;
+
+			nfs_read_send(priv, slot);
+		}
+
+		net_poll();
+	}
+}
+
+/*
+ * nfs_read_reply - Put the data of a READ reply into the fifo
+ */
+static int nfs_read_reply(struct file_priv *priv, struct nfs_read_slot *slot)
+{
+	struct packet *nfs_packet = slot->reply;
+	uint32_t *p, status;
+	uint32_t rlen, eof;
+	int nfserr, ret;
+
+	/*
 	 * struct READ3resok {
 	 * 	post_op_attr file_attributes;
 	 * 	count3 count;
@@ -1005,18 +1253,9 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 * 	READ3resfail resfail;
 	 * };
 	 */
-	p = &(data[0]);
-	p = rpc_add_credentials(p);
-
-	p = nfs_add_fh3(p, &priv->fh);
-	p = nfs_add_uint64(p, offset);
-	p = nfs_add_uint32(p, readlen);
-
-	len = p - &(data[0]);
-
-	nfs_packet = rpc_req(priv->npriv, PROG_NFS, NFSPROC3_READ, data, len);
-	if (IS_ERR(nfs_packet))
-		return PTR_ERR(nfs_packet);
+	ret = rpc_check_reply(nfs_packet, PROG_NFS, slot->xid, &nfserr);
+	if (ret)
+		return ret;
 
 	p = (void *)nfs_packet->data + sizeof(struct rpc_reply);
 	status = ntoh32(net_read_uint32(p++));
@@ -1040,14 +1279,59 @@ static int nfs_read_req(struct file_priv *priv, uint64_t offset,
 	 */
 	p += 2;
 
-	if (readlen && !rlen && !eof) {
-		nfs_free_packet(nfs_packet);
+	if (rlen > slot->count ||
+	    (void *)p + rlen > (void *)nfs_packet->data + nfs_packet->len)
+		return -EIO;
+
+	if (slot->count && !rlen && !eof)
 		return -EIO;
-	}
 
 	kfifo_put(priv->fifo, (char *)p, rlen);
 
-	nfs_free_packet(nfs_packet);
+	return rlen;
+}
+
+/*
+ * nfs_read_next - Read the next piece of a file into the fifo
+ */
+static int nfs_read_next(struct file_priv *priv, loff_t pos)
+{
+	struct nfs_read_slot *head;
+	int ret;
+
+	/* (re)start at the current position */
+	if (priv->nslots && nfs_read_slot(priv, 0)->offset != pos)
+		nfs_read_cancel(priv);
+
+	if (!priv->nslots)
+		priv->next_offset = pos;
+
+	nfs_read_fill_window(priv);
+
+	head = nfs_read_slot(priv, 0);
+
+	ret = nfs_read_wait(priv, head);
+	if (!ret)
+		ret = nfs_read_reply(priv, head);
+
+	free(head->reply);
+	head->reply = NULL;
+
+	priv->first_slot = (priv->first_slot + 1) % NFS_READ_WINDOW;
+	priv->nslots--;
+
+	if (ret < 0) {
+		nfs_read_cancel(priv);
+		return ret;
+	}
+
+	/* calls for the following data are off after a short read */
+	if (ret != head->count) {
+		nfs_read_cancel(priv);
+		priv->next_offset = head->offset + ret;
+	}
+
+	nfs_read_fill_window(priv);
 
 	return 0;
 }
@@ -1072,6 +1356,8 @@ static int nfs_truncate(struct device *dev, FILE *f, loff_t size)
 
 static void nfs_do_close(struct file_priv *priv)
 {
+	nfs_read_cancel(priv);
+
 	if (priv->fifo)
 		kfifo_free(priv->fifo);
 
@@ -1168,8 +1454,9 @@ static int nfs_open(struct device *dev, FILE *file, const char *filename)
 	priv->npriv = npriv;
 	file->priv = priv;
 	file->size = inode->i_size;
+	priv->size = inode->i_size;
 
-	priv->fifo = kfifo_alloc(1024);
+	priv->fifo = kfifo_alloc(npriv->rsize);
 	if (!priv->fifo) {
 		free(priv);
 		return -ENOMEM;
@@ -1197,11 +1484,8 @@ static int nfs_read(struct device *dev, FILE *file, void *buf, size_t insize)
 {
 	struct file_priv *priv = file->priv;
 
-	if (insize > 1024)
-		insize = 1024;
-
 	if (insize && !kfifo_len(priv->fifo)) {
-		int ret = nfs_read_req(priv, file->pos, insize);
+		int ret = nfs_read_next(priv, file->pos);
 		if (ret)
 			return ret;
 	}
@@ -1214,6 +1498,7 @@ static int nfs_lseek(struct device *dev, FILE *file, loff_t pos)
 	struct file_priv *priv = file->priv;
 
 	kfifo_reset(priv->fifo);
+	nfs_read_cancel(priv);
 
 	return 0;
 }
@@ -1500,6 +1785,8 @@ static int nfs_probe(struct device *dev)
 		goto err2;
 	}
 
+	nfs_set_rsize(npriv, fsdev);
+
 	nfs_set_rootarg(npriv, fsdev);
 
 	free(tmp);
@@ -25,11 +25,13 @@
 #include <xfuncs.h>
 #include <linux/sizes.h>
 
-#define CHUNK_SIZE	(4096 * 2)
-
+/*
+ * File data is stored in a list of extents. Files usually consist of a
+ * single extent, see ramfs_truncate_up().
+ */
 struct ramfs_chunk {
 	unsigned long ofs;
-	int size;
+	unsigned long size;
 	struct list_head list;
 	char data[];
 };
@@ -48,6 +50,9 @@ struct ramfs_inode {
 	struct list_head data;
 
 	struct ramfs_chunk *current_chunk;
+
+	/* number of open files which have memmapped the data */
+	unsigned int mapped;
 };
 
 static inline struct ramfs_inode *to_ramfs_inode(struct inode *inode)
@@ -190,7 +195,8 @@ static const struct inode_operations ramfs_dir_inode_operations =
 };
 
 static struct ramfs_chunk *ramfs_find_chunk(struct ramfs_inode *node,
-					    unsigned long pos, int *ofs, int *len)
+					    unsigned long pos, unsigned long *ofs,
+					    unsigned long *len)
 {
 	struct ramfs_chunk *data, *cur = node->current_chunk;
 
@@ -220,7 +226,8 @@ static int ramfs_read(struct device *_dev, FILE *f, void *buf, size_t insize)
 	struct inode *inode = f->f_inode;
 	struct ramfs_inode *node = to_ramfs_inode(inode);
 	struct ramfs_chunk *data;
-	int ofs, len, now;
+	unsigned long ofs, len;
+	int now;
 	unsigned long pos = f->pos;
 	int size = insize;
 
@@ -231,9 +238,9 @@ static int ramfs_read(struct device *_dev, FILE *f, void *buf, size_t insize)
 		if (!data)
 			return -EINVAL;
 
-		debug("%s: pos: %lu ofs: %d len: %d\n", __func__, pos, ofs, len);
+		debug("%s: pos: %lu ofs: %lu len: %lu\n", __func__, pos, ofs, len);
 
-		now = min(size, len);
+		now = min_t(unsigned long, size, len);
 
 		memcpy(buf, data->data + ofs, now);
 
@@ -251,7 +258,8 @@ static int ramfs_write(struct device *_dev, FILE *f, const void *buf,
 	struct inode *inode = f->f_inode;
 	struct ramfs_inode *node = to_ramfs_inode(inode);
 	struct ramfs_chunk *data;
-	int ofs, len, now;
+	unsigned long ofs, len;
+	int now;
 	unsigned long pos = f->pos;
 	int size = insize;
 
@@ -262,9 +270,9 @@ static int ramfs_write(struct device *_dev, FILE *f, const void *buf,
 		if (!data)
 			return -EINVAL;
 
-		debug("%s: pos: %lu ofs: %d len: %d\n", __func__, pos, ofs, len);
+		debug("%s: pos: %lu ofs: %lu len: %lu\n", __func__, pos, ofs, len);
 
-		now = min(size, len);
+		now = min_t(unsigned long, size, len);
 
 		memcpy(data->data + ofs, buf, now);
 
@@ -285,23 +293,25 @@ static void ramfs_truncate_down(struct ramfs_inode *node, unsigned long size)
 			list_del(&data->list);
 			node->alloc_size -= data->size;
 			ramfs_put_chunk(data);
+		} else if (data->ofs + data->size > size &&
+			   size < node->size) {
+			/* space beyond the file size is expected to be zeroed */
+			memset(data->data + size - data->ofs, 0,
+			       min(data->size, node->size - data->ofs) -
+			       (size - data->ofs));
 		}
 	}
 
 	node->current_chunk = NULL;
 }
 
-static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
+static int ramfs_alloc_chunks(struct ramfs_inode *node, unsigned long add)
 {
 	struct ramfs_chunk *data, *tmp;
 	LIST_HEAD(list);
-	unsigned long add = size - node->alloc_size;
 	unsigned long chunksize = add;
 	unsigned long alloc_size = 0;
 
-	if (node->alloc_size >= size)
-		return 0;
-
 	/*
 	 * We first try to allocate all space we need in a single chunk.
 	 * This may fail because of fragmented memory, so in case we cannot
@@ -350,6 +360,130 @@ static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
 	return -ENOSPC;
 }
 
+/*
+ * Resize the last chunk of a file. realloc() may move the chunk, so take
+ * it off the list meanwhile. This is not possible while the file is
+ * memmapped.
+ */
+static int ramfs_resize_last_chunk(struct ramfs_inode *node,
+				   unsigned long size)
+{
+	struct ramfs_chunk *data, *new;
+	unsigned long oldsize;
+
+	if (list_empty(&node->data))
+		return -ENOENT;
+
+	if (node->mapped)
+		return -EBUSY;
+
+	data = list_last_entry(&node->data, struct ramfs_chunk, list);
+	oldsize = data->size;
+
+	list_del(&data->list);
+
+	new = realloc(data, struct_size(data, data, size));
+	if (!new) {
+		list_add_tail(&data->list, &node->data);
+		return -ENOMEM;
+	}
+
+	if (size > oldsize)
+		memset(new->data + oldsize, 0, size - oldsize);
+
+	new->size = size;
+	list_add_tail(&new->list, &node->data);
+
+	node->alloc_size = node->alloc_size - oldsize + size;
+	node->current_chunk = NULL;
+
+	return 0;
+}
+
+static int ramfs_grow_last_chunk(struct ramfs_inode *node, unsigned long add)
+{
+	struct ramfs_chunk *data;
+
+	if (list_empty(&node->data))
+		return -ENOENT;
+
+	data = list_last_entry(&node->data, struct ramfs_chunk, list);
+
+	return ramfs_resize_last_chunk(node, data->size + add);
+}
+
+static int ramfs_truncate_up(struct ramfs_inode *node, unsigned long size)
+{
+	unsigned long add, extra;
+
+	if (node->alloc_size >= size)
+		return 0;
+
+	add = size - node->alloc_size;
+	extra = node->alloc_size;
+
+	/*
+	 * Files are usually written sequentially in small pieces, each of
+	 * which extends the file. Grow the allocation in proportion to the
+	 * current size, preferably by extending the last chunk, so that
+	 * even large files end up in a single extent which can be
+	 * memmapped. The excess is given back in ramfs_close().
+	 *
+	 * If that fails append a new chunk of the same size rather than
+	 * growing the last chunk by only what is needed, which would copy
+	 * the whole file again for every small write.
+	 */
+	if (extra && !ramfs_grow_last_chunk(node, add + extra))
+		return 0;
+
+	if (extra && !ramfs_alloc_chunks(node, add + extra))
+		return 0;
+
+	return ramfs_alloc_chunks(node, add);
+}
+
+/* Give back the space allocated in advance by ramfs_truncate_up() */
+static void ramfs_trim(struct ramfs_inode *node)
+{
+	struct ramfs_chunk *data;
+
+	if (list_empty(&node->data) || node->alloc_size <= node->size)
+		return;
+
+	data = list_last_entry(&node->data, struct ramfs_chunk, list);
+	if (data->ofs >= node->size)
+		return;
+
+	ramfs_resize_last_chunk(node, max_t(unsigned long, MIN_SIZE,
+					    node->size - data->ofs));
+}
+
+/* Copy a fragmented file into a single chunk */
+static int ramfs_coalesce(struct ramfs_inode *node)
+{
+	struct ramfs_chunk *data, *tmp, *new;
+
+	new = ramfs_get_chunk(node->size);
+	if (!new)
+		return -ENOMEM;
+
+	list_for_each_entry_safe(data, tmp, &node->data, list) {
+		if (data->ofs < node->size)
+			memcpy(new->data + data->ofs, data->data,
+			       min(data->size, node->size - data->ofs));
+
+		list_del(&data->list);
+		ramfs_put_chunk(data);
+	}
+
+	list_add_tail(&new->list, &node->data);
+
+	node->alloc_size = new->size;
+	node->current_chunk = NULL;
+
+	return 0;
+}
+
 static int ramfs_truncate(struct device *dev, FILE *f, loff_t size)
 {
 	struct inode *inode = f->f_inode;
@@ -387,17 +521,42 @@ static int ramfs_memmap(struct device *_dev, FILE *f, void **map, int flags)
 	struct inode *inode = f->f_inode;
 	struct ramfs_inode *node = to_ramfs_inode(inode);
 	struct ramfs_chunk *data;
+	int ret;
 
 	if (list_empty(&node->data))
 		return -EINVAL;
 
-	if (!list_is_singular(&node->data))
-		return -EINVAL;
+	if (!list_is_singular(&node->data)) {
+		/* other files may still use the current mapping */
+		if (node->mapped)
+			return -EBUSY;
+
+		ret = ramfs_coalesce(node);
+		if (ret)
+			return ret;
+	}
 
 	data = list_first_entry(&node->data, struct ramfs_chunk, list);
 
 	*map = data->data;
 
+	if (!f->priv) {
+		f->priv = node;
+		node->mapped++;
+	}
+
+	return 0;
+}
+
+static int ramfs_close(struct device *dev, FILE *f)
+{
+	struct ramfs_inode *node = to_ramfs_inode(f->f_inode);
+
+	if (f->priv)
+		node->mapped--;
+
+	ramfs_trim(node);
+
 	return 0;
 }
 
@@ -448,6 +607,7 @@ static struct fs_driver ramfs_driver = {
 	.read      = ramfs_read,
 	.write     = ramfs_write,
 	.memmap    = ramfs_memmap,
+	.close     = ramfs_close,
 	.truncate  = ramfs_truncate,
 	.flags     = FS_DRIVER_NO_DEV,
 	.drv = {
@@ -32,7 +32,9 @@
 #include <linux/stat.h>
 #include <linux/err.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 #include <kfifo.h>
+#include <magicvar.h>
 #include <parseopt.h>
 #include <linux/sizes.h>
 
@@ -46,6 +48,9 @@
 /* After this time without a response from the server we will resend a packet */
 #define TFTP_RESEND_TIMEOUT	SECOND
 
+/* Lower bound for the resend timeout derived from the measured round trip time */
+#define TFTP_RESEND_TIMEOUT_MIN	(20 * MSECOND)
+
 /* After this time without progress we will bail out */
 #define TFTP_TIMEOUT		((TIMEOUT * 3) * SECOND)
 
@@ -73,8 +78,16 @@
 
 #define TFTP_BLOCK_SIZE		512	/* default TFTP block size */
 #define TFTP_MTU_SIZE		1432	/* MTU based block size */
+#define TFTP_MAX_BLOCK_SIZE	65464	/* RFC 2348 maximum */
 #define TFTP_MAX_WINDOW_SIZE	CONFIG_FS_TFTP_MAX_WINDOW_SIZE
 
+/* windowsize increase after a download without lost blocks */
+#define TFTP_WINDOW_STEP	4
+
+/* the windowsize is halved when more than one out of this many windows had
+   to be restarted */
+#define TFTP_LOSS_WINDOWS	4
+
 /* allocate this number of blocks more than needed in the fifo */
 #define TFTP_EXTRA_BLOCKS	2
 
@@ -93,10 +106,26 @@
 #endif
 
 static int g_tftp_window_size = DIV_ROUND_UP(TFTP_MAX_WINDOW_SIZE, 2);
+static int g_tftp_block_size = TFTP_MTU_SIZE;
+static uint32_t g_tftp_throughput;
+
+/* transfer parameters learned from previous downloads from a server */
+struct tftp_link {
+	IPaddr_t server;
+	unsigned int windowsize;
+	unsigned int blocksize;
+	uint64_t srtt;		/* smoothed round trip time */
+	uint64_t rttvar;	/* round trip time variation */
+
+	struct list_head list;
+};
+
+static LIST_HEAD(tftp_links);
 
 struct tftp_block {
 	uint16_t id;
 	uint16_t len;
+	void *in_place;		/* data has been placed in the reader's buffer */
 
 	struct list_head list;
 	uint8_t data[];
@@ -124,6 +153,22 @@ struct file_priv {
 	unsigned int windowsize;
 	bool is_getattr;
 	struct tftp_cache cache;
+
+	struct tftp_link *link;
+	uint64_t rto;		/* resend timeout */
+	uint64_t ack_time;	/* time of the last ACK, 0 when it was a resend */
+	uint64_t start_time;
+	loff_t received;
+	uint16_t acked;		/* block of the last ACK */
+	unsigned int windows;	/* number of ACKs sent */
+	unsigned int losses;	/* number of windows restarted due to lost blocks */
+	bool gap;		/* blocks are missing in the current window */
+
+	/* buffer of a running tftp_read() which receives the data directly
+	   while the fifo is empty */
+	void *dst;
+	size_t dst_len;
+	size_t dst_pos;
 };
 
 struct tftp_priv {
@@ -155,8 +200,22 @@ static void tftp_window_cache_free(struct tftp_cache *cache)
 		free(block);
 }
 
+static void tftp_window_cache_drop_in_place(struct tftp_cache *cache)
+{
+	struct tftp_block *block, *tmp;
+
+	list_for_each_entry_safe(block, tmp, &cache->blocks, list) {
+		if (!block->in_place)
+			continue;
+
+		list_del(&block->list);
+		free(block);
+	}
+}
+
+/* when 'in_place' is set, 'data' points into the reader's buffer already */
 static int tftp_window_cache_insert(struct tftp_cache *cache, uint16_t id,
-				    void const *data, size_t len)
+				    void const *data, size_t len, bool in_place)
 {
 	struct tftp_block *block, *new;
 
@@ -169,8 +228,14 @@ static int tftp_window_cache_insert(struct tftp_cache *cache, uint16_t id,
 		break;
 	}
 
-	new = xzalloc(sizeof(*new) + len);
-	memcpy(new->data, data, len);
+	if (in_place) {
+		new = xzalloc(sizeof(*new));
+		new->in_place = (void *)data;
+	} else {
+		new = xzalloc(sizeof(*new) + len);
+		memcpy(new->data, data, len);
+	}
+
 	new->id = id;
 	new->len = len;
 	list_add_tail(&new->list, &block->list);
@@ -178,6 +243,125 @@ static int tftp_window_cache_insert(struct tftp_cache *cache, uint16_t id,
 	return 0;
 }
 
+static unsigned int tftp_max_window_size(void)
+{
+	return clamp_t(int, g_tftp_window_size, 1, TFTP_MAX_WINDOW_SIZE);
+}
+
+static unsigned int tftp_max_block_size(void)
+{
+	/* blocks which do not fit into a single ethernet frame arrive as
+	   fragmented IP datagrams */
+	if (!IS_ENABLED(CONFIG_NET_IP_REASSEMBLY))
+		return TFTP_MTU_SIZE;
+
+	return clamp_t(int, g_tftp_block_size, TFTP_BLOCK_SIZE,
+		       TFTP_MAX_BLOCK_SIZE);
+}
+
+static struct tftp_link *tftp_link_get(IPaddr_t server)
+{
+	struct tftp_link *link;
+
+	list_for_each_entry(link, &tftp_links, list)
+		if (link->server == server)
+			return link;
+
+	link = xzalloc(sizeof(*link));
+	link->server = server;
+	link->windowsize = tftp_max_window_size();
+	link->blocksize = min_t(unsigned int, TFTP_MTU_SIZE,
+				tftp_max_block_size());
+	list_add(&link->list, &tftp_links);
+
+	return link;
+}
+
+static uint64_t tftp_link_rto(const struct tftp_link *link)
+{
+	if (!link->srtt)
+		return TFTP_RESEND_TIMEOUT;
+
+	return clamp_t(uint64_t, link->srtt + 4 * link->rttvar,
+		       TFTP_RESEND_TIMEOUT_MIN, TFTP_RESEND_TIMEOUT);
+}
+
+/* RFC 6298 round trip time estimation */
+static void tftp_rtt_sample(struct file_priv *priv)
+{
+	struct tftp_link *link = priv->link;
+	uint64_t rtt = get_time_ns() - priv->ack_time;
+	uint64_t delta;
+
+	priv->ack_time = 0;
+
+	if (!link->srtt) {
+		link->srtt = rtt;
+		link->rttvar = rtt / 2;
+	} else {
+		delta = rtt > link->srtt ? rtt - link->srtt : link->srtt - rtt;
+		link->rttvar = (3 * link->rttvar + delta) / 4;
+		link->srtt = (7 * link->srtt + rtt) / 8;
+	}
+
+	priv->rto = tftp_link_rto(link);
+}
+
+/*
+ * The windowsize is fixed once it has been negotiated, so it can only be
+ * adapted for the next download from the same server: additive increase
+ * after a download without losses, multiplicative decrease when too many
+ * windows had to be restarted. Blocks larger than the MTU are given up first
+ * on losses, as a single lost fragment costs the whole block.
+ */
+static void tftp_link_update(struct file_priv *priv)
+{
+	struct tftp_link *link = priv->link;
+	unsigned int max_window = tftp_max_window_size();
+
+	pr_debug("%u windows of %u x %u bytes, %u restarted, srtt %llu us\n",
+		 priv->windows, priv->windowsize, priv->blocksize,
+		 priv->losses, link->srtt / 1000);
+
+	if (priv->err == -ETIMEDOUT ||
+	    priv->losses * TFTP_LOSS_WINDOWS > priv->windows) {
+		if (priv->blocksize > TFTP_MTU_SIZE)
+			link->blocksize = TFTP_MTU_SIZE;
+		else if (priv->windowsize > 1)
+			link->windowsize = max(priv->windowsize / 2, 1U);
+	} else if (!priv->losses && priv->state == STATE_DONE && !priv->err) {
+		if (link->windowsize < max_window)
+			link->windowsize = min(link->windowsize + TFTP_WINDOW_STEP,
+					       max_window);
+		else
+			link->blocksize = tftp_max_block_size();
+	}
+}
+
+/* window and block size to request from the server */
+static unsigned int tftp_request_windowsize(struct file_priv *priv)
+{
+	/* atm, windowsize is supported only for RRQ and there is no need to
+	   request a full window when we are just looking up file attributes */
+	if (priv->push || priv->is_getattr)
+		return 1;
+
+	return min(priv->link->windowsize, tftp_max_window_size());
+}
+
+static unsigned int tftp_request_blocksize(struct file_priv *priv)
+{
+	/* use only a minimal blksize for getattr operations */
+	if (priv->is_getattr)
+		return TFTP_BLOCK_SIZE;
+
+	/* outgoing datagrams are not fragmented */
+	if (priv->push)
+		return TFTP_MTU_SIZE;
+
+	return min(priv->link->blocksize, tftp_max_block_size());
+}
+
 static int tftp_truncate(struct device *dev, FILE *f, loff_t size)
 {
 	return 0;
@@ -209,14 +393,7 @@ static int tftp_send(struct file_priv *priv)
 	switch (priv->state) {
 	case STATE_RRQ:
 	case STATE_WRQ:
-		if (priv->push || priv->is_getattr)
-			/* atm, windowsize is supported only for RRQ and there
-			   is no need to request a full window when we are
-			   just looking up file attributes */
-			window_size = 1;
-		else
-			window_size = min_t(unsigned int, g_tftp_window_size,
-					    TFTP_MAX_WINDOW_SIZE);
+		window_size = tftp_request_windowsize(priv);
 
 		xp = pkt;
 		s = (uint16_t *)pkt;
@@ -237,9 +414,7 @@ static int tftp_send(struct file_priv *priv)
 				'\0',	/* "timeout" */
 				TIMEOUT, '\0',
 				'\0',	/* "blksize" */
-				/* use only a minimal blksize for getattr
-				   operations, */
-				priv->is_getattr ? TFTP_BLOCK_SIZE : TFTP_MTU_SIZE);
+				tftp_request_blocksize(priv));
 		pkt++;
 
 		if (!priv->push)
@@ -268,6 +443,16 @@ static int tftp_send(struct file_priv *priv)
 		priv->ack_block += priv->windowsize;
 		pkt = (unsigned char *)s;
 		len = pkt - xp;
+
+		/* the answer to a repeated ACK is no valid RTT sample */
+		priv->resend_timeout = get_time_ns();
+		if (priv->windows && priv->acked == priv->last_block)
+			priv->ack_time = 0;
+		else
+			priv->ack_time = priv->resend_timeout;
+		priv->acked = priv->last_block;
+		priv->gap = false;
+		priv->windows++;
 		break;
 	}
 
@@ -305,9 +490,16 @@ static int tftp_poll(struct file_priv *priv)
 		return -EINTR;
 	}
 
-	if (is_timeout(priv->resend_timeout, TFTP_RESEND_TIMEOUT)) {
+	/* process pending packets first; the caller might not have polled
+	   for a while */
+	net_poll();
+
+	if (is_timeout(priv->resend_timeout, priv->rto)) {
 		printf("T ");
 		priv->resend_timeout = get_time_ns();
+		priv->rto = min(priv->rto * 2, TFTP_RESEND_TIMEOUT);
+		if (priv->state == STATE_RDATA && !priv->gap)
+			priv->losses++;
 		return TFTP_ERR_RESEND;
 	}
 
@@ -317,8 +509,6 @@ static int tftp_poll(struct file_priv *priv)
 		return -ETIMEDOUT;
 	}
 
-	net_poll();
-
 	return 0;
 }
 
@@ -350,8 +540,8 @@ static int tftp_parse_oack(struct file_priv *priv, unsigned char *pkt, int len)
 		s = val + strlen(val) + 1;
 	}
 
-	if (priv->blocksize > TFTP_MTU_SIZE ||
-	    priv->windowsize > TFTP_MAX_WINDOW_SIZE ||
+	if (priv->blocksize > tftp_request_blocksize(priv) ||
+	    priv->windowsize > tftp_request_windowsize(priv) ||
 	    priv->windowsize == 0) {
 		pr_warn("tftp: invalid oack response\n");
 		return -EINVAL;
@@ -388,6 +578,9 @@ static int tftp_allocate_transfer(struct file_priv *priv)
 
 	INIT_LIST_HEAD(&priv->cache.blocks);
 
+	priv->rto = tftp_link_rto(priv->link);
+	priv->start_time = get_time_ns();
+
 	return 0;
 
 err:
@@ -397,10 +590,22 @@ static int tftp_allocate_transfer(struct file_priv *priv)
 	return priv->err;
 }
 
+static void tftp_update_throughput(struct file_priv *priv)
+{
+	uint64_t elapsed = get_time_ns() - priv->start_time;
+
+	if (!elapsed)
+		return;
+
+	/* in KiB/s */
+	g_tftp_throughput = div64_u64(priv->received * (SECOND / SZ_1K),
+				      elapsed);
+}
+
 static void tftp_put_data(struct file_priv *priv, uint16_t block,
 			  void const *pkt, size_t len)
 {
-	unsigned int sz;
+	unsigned int sz = 0;
 
 	if (len > priv->blocksize) {
 		pr_warn("tftp: oversized packet (%zu > %d) received\n",
@@ -410,7 +615,18 @@ static void tftp_put_data(struct file_priv *priv, uint16_t block,
 
 	priv->last_block = block;
 
-	sz = kfifo_put(priv->fifo, pkt, len);
+	/* bypass the fifo as long as there is nothing queued in it */
+	if (priv->dst && !kfifo_len(priv->fifo)) {
+		void *dst = priv->dst + priv->dst_pos;
+
+		sz = min(len, priv->dst_len - priv->dst_pos);
+		if (dst != pkt)
+			memmove(dst, pkt, sz);
+		priv->dst_pos += sz;
+	}
+
+	sz += kfifo_put(priv->fifo, pkt + sz, len - sz);
+	priv->received += sz;
 
 	if (sz != len) {
 		pr_err("tftp: not enough room in kfifo (only %u out of %zu written)\n",
@@ -421,6 +637,7 @@ static void tftp_put_data(struct file_priv *priv, uint16_t block,
 		tftp_send(priv);
 		priv->err = 0;
 		priv->state = STATE_DONE;
+		tftp_update_throughput(priv);
 	}
 }
 
@@ -451,7 +668,8 @@ static void tftp_apply_window_cache(struct file_priv *priv)
 		if (block->id != (uint16_t)(priv->last_block + 1))
 			return;
 
-		tftp_put_data(priv, block->id, block->data, block->len);
+		tftp_put_data(priv, block->id, block->in_place ?: block->data,
+			      block->len);
 
 		list_del(&block->list);
 
@@ -459,10 +677,30 @@ static void tftp_apply_window_cache(struct file_priv *priv)
 	}
 }
 
+/*
+ * Place of a block following the expected one in the reader's buffer, NULL if
+ * it does not fit there. All blocks but the last one have the full blocksize.
+ */
+static void *tftp_dst_block(struct file_priv *priv, uint16_t block, size_t len)
+{
+	size_t offset;
+
+	if (!priv->dst || kfifo_len(priv->fifo))
+		return NULL;
+
+	offset = priv->dst_pos +
+		(size_t)(uint16_t)(block - priv->last_block - 1) * priv->blocksize;
+	if (offset + len > priv->dst_len)
+		return NULL;
+
+	return priv->dst + offset;
+}
+
 static void tftp_handle_data(struct file_priv *priv, uint16_t block,
 			     void const *data, size_t len)
 {
 	uint16_t exp_block;
+	void *dst;
 	int rc;
 
 	exp_block = priv->last_block + 1;
@@ -470,26 +708,39 @@ static void tftp_handle_data(struct file_priv *priv, uint16_t block,
 	if (exp_block == block) {
 		/* datagram over network is the expected one; put it in the
 		   fifo directly and try to apply cached items then */
+		if (priv->ack_time)
+			tftp_rtt_sample(priv);
 		tftp_timer_reset(priv);
 		tftp_put_data(priv, block, data, len);
 		tftp_apply_window_cache(priv);
+	} else if (is_block_before(block, exp_block)) {
+		/* duplicate of a block which was already received before
+		   the window has been restarted */
+		pr_vdebug("duplicate block %u\n", block);
 	} else if (!in_window(block, exp_block, priv->ack_block)) {
 		/* completely unexpected and unrelated to actual window;
 		   ignore the packet. */
 		printf("B");
-		if (g_tftp_window_size > 1)
-			pr_warn_once("Unexpected packet. global.tftp.windowsize set too high?\n");
 	} else {
-		/* The 'rc < 0' below happens e.g. when datagrams in the first
-		   part of the transfer window are dropped.
-
-		   TODO: this will usually result in a timeout
-		   (TFTP_RESEND_TIMEOUT).  It should be possible to bypass
-		   this timeout by acknowledging the last packet (e.g. by
-		   doing 'priv->ack_block = priv->last_block' here). */
-		rc = tftp_window_cache_insert(&priv->cache, block, data, len);
+		/* out-of-order blocks are written in place when possible,
+		   only their position is cached */
+		dst = tftp_dst_block(priv, block, len);
+		if (dst)
+			memcpy(dst, data, len);
+
+		rc = tftp_window_cache_insert(&priv->cache, block,
+					      dst ?: data, len, dst);
 		if (rc < 0)
 			printf("M");
+
+		/* The last block of the window arrived but some before it
+		   were lost. Restart the window at the first missing block
+		   right now instead of waiting for the resend timeout; the
+		   blocks after it are kept in the cache. */
+		if (block == priv->ack_block && !priv->gap) {
+			priv->gap = true;
+			priv->losses++;
+		}
 	}
 }
 
@@ -681,6 +932,8 @@ static struct file_priv *tftp_do_open(struct device *dev,
 	priv->blocksize = TFTP_BLOCK_SIZE;
 	priv->windowsize = 1;
 	priv->is_getattr = is_getattr;
+	priv->link = tftp_link_get(tpriv->server);
+	priv->rto = TFTP_RESEND_TIMEOUT;
 
 	parseopt_hu(fsdev->options, "port", &port);
 
@@ -790,6 +1043,9 @@ static int tftp_do_close(struct file_priv *priv)
 		}
 	}
 
+	if (!priv->push && !priv->is_getattr && priv->windows)
+		tftp_link_update(priv);
+
 	if (!priv->push && priv->state != STATE_DONE) {
 		uint16_t *pkt = net_udp_get_payload(priv->tftp_con);
 		*pkt++ = htons(TFTP_ERROR);
@@ -870,21 +1126,41 @@ static int tftp_read(struct device *dev, FILE *f, void *buf, size_t insize)
 			break;
 		}
 
+		/* once the fifo is drained, let large reads receive the data
+		   straight into 'buf' */
+		if (insize >= priv->blocksize && !kfifo_len(priv->fifo)) {
+			priv->dst = buf;
+			priv->dst_len = insize;
+			priv->dst_pos = 0;
+		}
+
 		/* send the ACK only when fifo has been nearly depleted; else,
 		   when tftp_read() is called with small 'insize' values, it
 		   is possible that there is read more data from the network
 		   than consumed by kfifo_get() and the fifo overflows */
-		if (priv->last_block == priv->ack_block &&
+		if ((priv->last_block == priv->ack_block || priv->gap) &&
 		    kfifo_len(priv->fifo) <= TFTP_EXTRA_BLOCKS * priv->blocksize)
 			tftp_send(priv);
 
 		ret = tftp_poll(priv);
 		if (ret == TFTP_ERR_RESEND)
 			tftp_send(priv);
+
+		if (priv->dst) {
+			outsize += priv->dst_pos;
+			buf += priv->dst_pos;
+			insize -= priv->dst_pos;
+			priv->dst = NULL;
+		}
+
 		if (ret < 0)
 			break;
 	}
 
+	/* 'buf' is not ours anymore; blocks which were placed in it out of
+	   order will be received again */
+	tftp_window_cache_drop_in_place(&priv->cache);
+
 	if (ret < 0)
 		return ret;
 
@@ -1071,7 +1347,17 @@ static struct fs_driver tftp_driver = {
 static int tftp_init(void)
 {
 	globalvar_add_simple_int("tftp.windowsize", &g_tftp_window_size, "%u");
+	globalvar_add_simple_int("tftp.blocksize", &g_tftp_block_size, "%u");
+	dev_add_param_uint32_ro(&global_device, "tftp.throughput",
+				&g_tftp_throughput, "%u");
 
 	return register_fs_driver(&tftp_driver);
 }
 coredevice_initcall(tftp_init);
+
+BAREBOX_MAGICVAR(global.tftp.windowsize,
+		 "Maximum TFTP windowsize (RFC 7440) for downloads");
+BAREBOX_MAGICVAR(global.tftp.blocksize,
+		 "Maximum TFTP blocksize for downloads, larger than the MTU requires IP reassembly");
+BAREBOX_MAGICVAR(global.tftp.throughput,
+		 "Throughput of the last complete TFTP download in KiB/s");
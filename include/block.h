@@ -4,6 +4,7 @@
 
 #include <driver.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/types.h>
 
 struct block_device;
@@ -45,6 +46,24 @@ struct block_device {
 
 	struct list_head buffered_blocks;
 	struct list_head idle_blocks;
+	struct hlist_head *chunk_hash;
+	unsigned int chunk_hash_bits;
+	struct rb_root dirty_chunks;
+
+	u32 cache_chunks; /* 0 means global.blockdevice.cache_chunks */
+	u32 cache_hits;
+	u32 cache_misses;
+	u32 cache_evictions;
+	u32 cache_readahead;
+	u32 cache_readahead_hits;
+	struct param_d *cache_params[6];
+
+	/* sequential read-ahead state */
+	sector_t ra_next;
+	unsigned int ra_window;
+	unsigned int ra_max;
+	/* ra_max chunks, for read-ahead and merging dirty chunks */
+	void *bounce_buf;
 
 	struct cdev cdev;
 
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef __BOOT_PROFILE_H
+#define __BOOT_PROFILE_H
+
+#include <linux/types.h>
+
+enum boot_profile_type {
+	BOOT_PROFILE_INITCALL,
+	BOOT_PROFILE_PROBE,
+	BOOT_PROFILE_DEFERRED,
+};
+
+struct boot_profile_event;
+
+#define BOOT_PROFILE_SUMMARY	(1 << 0)	/* aggregate events by name */
+#define BOOT_PROFILE_SORT	(1 << 1)	/* longest first */
+
+#ifdef CONFIG_BOOT_PROFILE
+struct boot_profile_event *boot_profile_start(enum boot_profile_type type,
+					      const char *name, const void *fn);
+void boot_profile_end(struct boot_profile_event *ev, int ret);
+void boot_profile_stop(void);
+
+void boot_profile_print(unsigned flags, u64 min_ns);
+int boot_profile_write_trace(const char *filename);
+#else
+static inline struct boot_profile_event *
+boot_profile_start(enum boot_profile_type type, const char *name, const void *fn)
+{
+	return NULL;
+}
+
+static inline void boot_profile_end(struct boot_profile_event *ev, int ret)
+{
+}
+
+static inline void boot_profile_stop(void)
+{
+}
+#endif
+
+#endif /* __BOOT_PROFILE_H */
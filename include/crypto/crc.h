@@ -15,4 +15,6 @@ struct crc32_state {
 	ulong crc;
 };
 
+int crc32_digest_register_arch(char *driver_name);
+
 #endif
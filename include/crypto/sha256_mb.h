@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * sha256_mb.h - core logic for multi-buffer SHA-256 implementations
+ */
+
+#ifndef _CRYPTO_SHA256_MB_H
+#define _CRYPTO_SHA256_MB_H
+
+#include <digest.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_base.h>
+
+#define SHA256_MB_MAX_LANES	8
+
+/* word i of the state of the message in lane j is state[i][j] */
+struct sha256_mb_state {
+	u32 state[SHA256_DIGEST_SIZE / 4][SHA256_MB_MAX_LANES];
+};
+
+/*
+ * Process @blocks blocks in every lane, starting at @data[lane]. Lanes
+ * without a message point to the data of another lane, their state is
+ * discarded.
+ */
+typedef void (sha256_mb_block_fn)(struct sha256_mb_state *st,
+				  const u8 *data[SHA256_MB_MAX_LANES],
+				  int blocks);
+
+int sha256_mb_digest(struct digest_mb_req *reqs, unsigned int num,
+		     unsigned int lanes, sha256_mb_block_fn *mb_fn,
+		     sha256_block_fn *block_fn);
+
+#endif /* _CRYPTO_SHA256_MB_H */
@@ -80,6 +80,8 @@ struct digest {
 int digest_algo_register(struct digest_algo *d);
 void digest_algo_unregister(struct digest_algo *d);
 void digest_algo_prints(const char *prefix);
+int digest_algo_for_each(int (*fn)(struct digest_algo *algo, void *data),
+			 void *data);
 
 struct digest *digest_alloc(const char *name);
 struct digest *digest_alloc_by_algo(enum hash_algo);
@@ -111,6 +113,55 @@ static inline void digest_free(struct digest *d)
 }
 #endif
 
+/* one buffer of a multi-buffer digest operation */
+struct digest_mb_req {
+	const void *data;
+	unsigned int len;
+	u8 *out;		/* receives the digest of data */
+};
+
+/*
+ * Implementations that process several independent buffers at once,
+ * typically one in each lane of SIMD registers. base.name is the digest
+ * they calculate, base.priority competes with the digest_algo of the same
+ * name.
+ */
+struct digest_mb_algo {
+	struct crypto_alg base;
+
+	int (*digest)(struct digest_mb_req *reqs, unsigned int num);
+
+	struct list_head list;
+};
+
+#ifdef CONFIG_DIGEST
+int digest_mb_algo_register(struct digest_mb_algo *algo);
+int digest_mb(const char *name, struct digest_mb_req *reqs, unsigned int num);
+#else
+static inline int digest_mb(const char *name, struct digest_mb_req *reqs,
+			    unsigned int num)
+{
+	return -ENOSYS;
+}
+#endif
+
+struct digest_bench_params {
+	const unsigned int *sizes;	/* buffer sizes to measure, ascending */
+	unsigned int num_sizes;
+	unsigned int align;		/* offset from a 64 byte boundary */
+	unsigned int min_time_ms;	/* minimum duration per measurement */
+};
+
+#ifdef CONFIG_DIGEST_BENCH
+int digest_bench(const char *algo, const struct digest_bench_params *params);
+#else
+static inline int digest_bench(const char *algo,
+			       const struct digest_bench_params *params)
+{
+	return -ENOSYS;
+}
+#endif
+
 static inline int digest_init(struct digest *d)
 {
 	return d->algo->init(d);
@@ -13,6 +13,7 @@ struct fit_handle {
 	const void *fit;
 	void *fit_alloc;
 	size_t size;
+	char *filename; /* for reading external data, NULL for fit_open_buf() */
 
 	bool verbose;
 	enum bootm_verify verify;
@@ -20,6 +21,10 @@ struct fit_handle {
 	struct device_node *root;
 	struct device_node *images;
 	struct device_node *configurations;
+
+	/* images whose hash was checked when opening their configuration */
+	struct device_node **hashed_images;
+	unsigned int num_hashed_images;
 };
 
 struct fit_handle *fit_open(const char *filename, bool verbose,
@@ -29,6 +29,9 @@
 /* The number of receive packet buffers */
 #define PKTBUFSRX	4
 
+/* maximum number of packets a device hands up in a single poll */
+#define ETH_RX_BUDGET	64
+
 struct device;
 
 struct eth_device {
@@ -39,6 +42,11 @@ struct eth_device {
 	int  (*open) (struct eth_device*);
 	int  (*send) (struct eth_device*, void *packet, int length);
 	int  (*recv) (struct eth_device*);
+	/*
+	 * Alternative to recv: pass up to @budget packets to net_receive()
+	 * and return the number of packets received.
+	 */
+	int  (*recv_batch) (struct eth_device*, int budget);
 	void (*halt) (struct eth_device*);
 	int  (*get_ethaddr) (struct eth_device*, u8 adr[6]);
 	int  (*set_ethaddr) (struct eth_device*, const unsigned char *adr);
@@ -79,6 +87,13 @@ struct eth_device {
 	unsigned int global_mode;
 
 	uint64_t last_link_check;
+
+	/* optional receive buffers, see eth_rx_pool_alloc() */
+	void *rx_pool;
+	unsigned int rx_pool_num;
+
+	uint32_t rx_packets;
+	uint32_t rx_dropped;
 };
 
 #define dev_to_edev(d) container_of(d, struct eth_device, dev)
@@ -147,6 +162,7 @@ struct ethernet {
 #define PROT_VLAN	0x8100		/* IEEE 802.1q protocol		*/
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 #define IP_BROADCAST    0xffffffff /* Broadcast IP aka 255.255.255.255 */
@@ -168,6 +184,9 @@ struct iphdr {
 	/* The options start here. */
 } __attribute__ ((packed));
 
+#define IP_MF		0x2000		/* more fragments flag */
+#define IP_OFFSET	0x1fff		/* fragment offset in 8 byte units */
+
 struct udphdr {
 	uint16_t	uh_sport;	/* source port */
 	uint16_t	uh_dport;	/* destination port */
@@ -175,6 +194,27 @@ struct udphdr {
 	uint16_t	uh_sum;		/* udp checksum */
 } __attribute__ ((packed));
 
+/*
+ *	Transmission Control Protocol (TCP) header.
+ */
+struct tcphdr {
+	uint16_t	th_sport;	/* source port */
+	uint16_t	th_dport;	/* destination port */
+	uint32_t	th_seq;		/* sequence number */
+	uint32_t	th_ack;		/* acknowledgement number */
+	uint8_t		th_off;		/* data offset in 32 bit words, upper nibble */
+	uint8_t		th_flags;
+	uint16_t	th_win;		/* receive window */
+	uint16_t	th_sum;		/* checksum */
+	uint16_t	th_urp;		/* urgent pointer */
+} __attribute__ ((packed));
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
 /*
  *	Address Resolution Protocol (ARP) header.
  */
@@ -298,6 +338,11 @@ static inline int net_eth_to_udplen(char *pkt)
 	return ntohs(udp->uh_ulen) - 8;
 }
 
+static inline struct tcphdr *net_eth_to_tcphdr(char *pkt)
+{
+	return (struct tcphdr *)(net_eth_to_iphdr(pkt) + 1);
+}
+
 int net_checksum_ok(unsigned char *, int);	/* Return true if cksum OK	*/
 uint16_t net_checksum(unsigned char *, int);	/* Calculate the checksum	*/
 
@@ -535,6 +580,7 @@ struct net_connection {
 	struct ethernet *et;
 	struct iphdr *ip;
 	struct udphdr *udp;
+	struct tcphdr *tcp;
 	struct eth_device *edev;
 	struct icmphdr *icmp;
 	unsigned char *packet;
@@ -557,6 +603,14 @@ static inline void net_free_packet(char *pkt)
 int net_alloc_packets(void **packets, int count);
 void net_free_packets(void **packets, unsigned count);
 
+int eth_rx_pool_alloc(struct eth_device *edev, unsigned int num);
+
+/* the @i-th receive buffer of size PKTSIZE allocated by eth_rx_pool_alloc() */
+static inline void *eth_rx_pool_buf(struct eth_device *edev, unsigned int i)
+{
+	return edev->rx_pool + i * PKTSIZE;
+}
+
 struct net_connection *net_udp_new(IPaddr_t dest, uint16_t dport,
 		rx_handler_f *handler, void *ctx);
 
@@ -584,6 +638,17 @@ static inline void *net_udp_get_payload(struct net_connection *con)
 int net_udp_send(struct net_connection *con, int len);
 int net_icmp_send(struct net_connection *con, int len);
 
+struct net_connection *net_tcp_new(IPaddr_t dest, uint16_t dport,
+		rx_handler_f *handler, void *ctx);
+int net_tcp_send(struct net_connection *con, int len);
+
+struct tcp_sock;
+
+struct tcp_sock *tcp_connect(IPaddr_t dest, uint16_t dport);
+int tcp_send(struct tcp_sock *sk, const void *buf, size_t len);
+int tcp_recv(struct tcp_sock *sk, void *buf, size_t len);
+void tcp_close(struct tcp_sock *sk);
+
 void led_trigger_network(enum led_trigger trigger);
 
 #define IFUP_FLAG_FORCE		(1 << 0)
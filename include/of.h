@@ -22,6 +22,7 @@ typedef u32 phandle;
 struct property {
 	char *name;
 	int length;
+	bool name_const;	/* name is not allocated */
 	void *value;
 	const void *value_const;
 	struct list_head list;
@@ -37,6 +38,7 @@ struct device_node {
 	struct list_head parent_list;
 	struct list_head list;
 	phandle phandle;
+	struct hlist_node phandle_hash;
 	struct device *dev;
 };
 
@@ -160,6 +162,9 @@ extern struct property *of_new_property_const(struct device_node *node,
 					      const void *data, int len);
 extern struct property *__of_new_property(struct device_node *node,
 					  const char *name, void *data, int len);
+extern struct property *__of_new_property_const(struct device_node *node,
+						const char *name,
+						const void *data, int len);
 extern void of_delete_property(struct property *pp);
 extern struct property *of_rename_property(struct device_node *np,
 					   const char *old_name, const char *new_name);
@@ -1286,6 +1291,7 @@ static inline int of_devices_ensure_probed_by_compatible(const char *compatible)
 }
 
 phandle of_get_tree_max_phandle(struct device_node *root);
+void of_node_set_phandle(struct device_node *node, phandle phandle);
 phandle of_node_create_phandle(struct device_node *node);
 int of_set_property_to_child_phandle(struct device_node *node, char *prop_name);
 
@@ -57,6 +57,8 @@ struct device_node;
 struct rsa_public_key *rsa_of_read_key(struct device_node *node);
 void rsa_key_free(struct rsa_public_key *key);
 const struct rsa_public_key *rsa_get_key(const char *name);
+int rsa_key_add(struct rsa_public_key *key);
+void rsa_key_remove(struct rsa_public_key *key);
 
 const struct rsa_public_key *rsa_key_next(const struct rsa_public_key *prev);
 
@@ -21,6 +21,13 @@ int uncompress_buf_to_fd(const void *input, size_t input_len,
 ssize_t uncompress_buf_to_buf(const void *input, size_t input_len,
 			      void **buf, void(*error_fn)(char *x));
 
+ssize_t uncompress_fill_to_buf(long(*fill)(void*, unsigned long),
+			       size_t size_hint, void **buf,
+			       void(*error_fn)(char *x));
+
+size_t uncompress_size_hint(const void *head, size_t head_len,
+			    const void *tail);
+
 void uncompress_err_stdout(char *);
 
 #endif /* __UNCOMPRESS_H */
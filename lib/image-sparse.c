@@ -244,3 +244,299 @@ void sparse_image_close(struct sparse_image_ctx *si)
 	close(si->fd);
 	free(si);
 }
+
+enum sparse_stream_state {
+	SPARSE_STREAM_FILE_HEADER,
+	SPARSE_STREAM_CHUNK_HEADER,
+	SPARSE_STREAM_RAW,
+	SPARSE_STREAM_FILL,
+	SPARSE_STREAM_SKIP,
+	SPARSE_STREAM_DONE,
+};
+
+#define SPARSE_STREAM_FILL_SIZE	SZ_128K
+
+struct sparse_image_stream {
+	sparse_stream_write_t write;
+	void *priv;
+	enum sparse_stream_state state;
+	struct sparse_header sparse;
+	struct chunk_header chunk;
+	int processed_chunks;
+	loff_t pos;
+	/* bytes still expected in the current state */
+	uint64_t need;
+	/* header bytes collected in the current state */
+	size_t have;
+	uint32_t fill_val;
+	uint64_t fill_sz;
+	uint32_t *fill_buf;
+};
+
+/*
+ * Consume up to ss->need bytes of header data, storing the first @dstsize
+ * of them in @dst and dropping the rest.
+ */
+static size_t sparse_stream_collect(struct sparse_image_stream *ss,
+				    const void *buf, size_t len,
+				    void *dst, size_t dstsize)
+{
+	size_t now = min_t(uint64_t, len, ss->need);
+
+	if (ss->have < dstsize)
+		memcpy(dst + ss->have, buf, min(now, dstsize - ss->have));
+
+	ss->have += now;
+	ss->need -= now;
+
+	return now;
+}
+
+static void sparse_stream_next_chunk(struct sparse_image_stream *ss)
+{
+	if (ss->processed_chunks == ss->sparse.total_chunks) {
+		ss->state = SPARSE_STREAM_DONE;
+		return;
+	}
+
+	ss->state = SPARSE_STREAM_CHUNK_HEADER;
+	ss->need = ss->sparse.chunk_hdr_sz;
+	ss->have = 0;
+}
+
+static int sparse_stream_file_header(struct sparse_image_stream *ss)
+{
+	if (!is_sparse_image(&ss->sparse))
+		return -EINVAL;
+
+	if (ss->sparse.file_hdr_sz < sizeof(struct sparse_header) ||
+	    ss->sparse.chunk_hdr_sz < sizeof(struct chunk_header) ||
+	    !ss->sparse.blk_sz || ss->sparse.blk_sz & 3)
+		return -EINVAL;
+
+	/* Skip the remaining bytes of a header longer than we expected */
+	ss->need = ss->sparse.file_hdr_sz - sizeof(struct sparse_header);
+
+	return 0;
+}
+
+static int sparse_stream_chunk_header(struct sparse_image_stream *ss)
+{
+	uint64_t chunk_data_sz;
+	unsigned int payload;
+
+	pr_debug("=== Chunk Header ===\n");
+	pr_debug("chunk_type: 0x%x\n", ss->chunk.chunk_type);
+	pr_debug("chunk_data_sz: 0x%x\n", ss->chunk.chunk_sz);
+	pr_debug("total_size: 0x%x\n", ss->chunk.total_sz);
+
+	if (ss->chunk.total_sz < ss->sparse.chunk_hdr_sz)
+		return -EINVAL;
+
+	chunk_data_sz = (uint64_t) ss->sparse.blk_sz * ss->chunk.chunk_sz;
+	payload = ss->chunk.total_sz - ss->sparse.chunk_hdr_sz;
+
+	ss->processed_chunks++;
+	ss->need = payload;
+	ss->have = 0;
+
+	switch (ss->chunk.chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (payload != chunk_data_sz)
+			return -EINVAL;
+
+		ss->state = SPARSE_STREAM_RAW;
+		break;
+
+	case CHUNK_TYPE_FILL:
+		if (payload != sizeof(uint32_t))
+			return -EINVAL;
+
+		ss->fill_sz = chunk_data_sz;
+		ss->state = SPARSE_STREAM_FILL;
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		ss->pos += chunk_data_sz;
+		ss->state = SPARSE_STREAM_SKIP;
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		if (payload != sizeof(uint32_t))
+			return -EINVAL;
+
+		ss->state = SPARSE_STREAM_SKIP;
+		break;
+
+	default:
+		pr_err("Unknown chunk type 0x%04x",
+				ss->chunk.chunk_type);
+		return -EINVAL;
+	}
+
+	if (!ss->need)
+		sparse_stream_next_chunk(ss);
+
+	return 0;
+}
+
+static int sparse_stream_fill(struct sparse_image_stream *ss)
+{
+	uint64_t remaining = ss->fill_sz;
+	size_t bufsz = min_t(uint64_t, remaining, SPARSE_STREAM_FILL_SIZE);
+	int ret, i;
+
+	if (!remaining)
+		return 0;
+
+	if (!ss->fill_buf) {
+		ss->fill_buf = malloc(SPARSE_STREAM_FILL_SIZE);
+		if (!ss->fill_buf)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < bufsz / sizeof(uint32_t); i++)
+		ss->fill_buf[i] = ss->fill_val;
+
+	while (remaining) {
+		size_t now = min_t(uint64_t, remaining, bufsz);
+
+		ret = ss->write(ss->priv, ss->pos, ss->fill_buf, now);
+		if (ret)
+			return ret;
+
+		ss->pos += now;
+		remaining -= now;
+	}
+
+	return 0;
+}
+
+/**
+ * sparse_image_stream_new - create a push style sparse image parser
+ * @write:	called for every range of output data
+ * @priv:	passed to @write
+ *
+ * Unlike sparse_image_open() this doesn't need the whole image to be
+ * available up front: the image is passed in arbitrarily sized pieces
+ * with sparse_image_stream_feed() as it arrives, and the resulting data
+ * is handed to @write. Data from raw chunks is passed directly from the
+ * buffers given to sparse_image_stream_feed() without copying it.
+ */
+struct sparse_image_stream *sparse_image_stream_new(sparse_stream_write_t write,
+						    void *priv)
+{
+	struct sparse_image_stream *ss;
+
+	ss = xzalloc(sizeof(*ss));
+	ss->write = write;
+	ss->priv = priv;
+	ss->state = SPARSE_STREAM_FILE_HEADER;
+	ss->need = sizeof(struct sparse_header);
+
+	return ss;
+}
+
+int sparse_image_stream_feed(struct sparse_image_stream *ss, const void *buf,
+			     size_t len)
+{
+	int ret;
+
+	while (len) {
+		size_t now;
+
+		switch (ss->state) {
+		case SPARSE_STREAM_FILE_HEADER:
+			now = sparse_stream_collect(ss, buf, len, &ss->sparse,
+						    sizeof(ss->sparse));
+			if (!ss->need && ss->have == sizeof(ss->sparse)) {
+				ret = sparse_stream_file_header(ss);
+				if (ret)
+					return ret;
+			}
+
+			if (!ss->need)
+				sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_CHUNK_HEADER:
+			now = sparse_stream_collect(ss, buf, len, &ss->chunk,
+						    sizeof(ss->chunk));
+			if (!ss->need) {
+				ret = sparse_stream_chunk_header(ss);
+				if (ret)
+					return ret;
+			}
+			break;
+
+		case SPARSE_STREAM_RAW:
+			now = min_t(uint64_t, len, ss->need);
+
+			ret = ss->write(ss->priv, ss->pos, buf, now);
+			if (ret)
+				return ret;
+
+			ss->pos += now;
+			ss->need -= now;
+			if (!ss->need)
+				sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_FILL:
+			now = sparse_stream_collect(ss, buf, len, &ss->fill_val,
+						    sizeof(ss->fill_val));
+			if (!ss->need) {
+				ret = sparse_stream_fill(ss);
+				if (ret)
+					return ret;
+
+				sparse_stream_next_chunk(ss);
+			}
+			break;
+
+		case SPARSE_STREAM_SKIP:
+			now = min_t(uint64_t, len, ss->need);
+
+			ss->need -= now;
+			if (!ss->need)
+				sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_DONE:
+		default:
+			/* ignore trailing data like sparse_image_read() does */
+			return 0;
+		}
+
+		buf += now;
+		len -= now;
+	}
+
+	return 0;
+}
+
+/**
+ * sparse_image_stream_finish - check that a streamed image was complete
+ * @ss:		the sparse image stream
+ *
+ * Return: 0 if all chunks announced in the header have been processed,
+ * -EINVAL if the image was truncated.
+ */
+int sparse_image_stream_finish(struct sparse_image_stream *ss)
+{
+	return ss->state == SPARSE_STREAM_DONE ? 0 : -EINVAL;
+}
+
+loff_t sparse_image_stream_size(struct sparse_image_stream *ss)
+{
+	return (loff_t)ss->sparse.blk_sz * ss->sparse.total_blks;
+}
+
+void sparse_image_stream_free(struct sparse_image_stream *ss)
+{
+	if (!ss)
+		return;
+
+	free(ss->fill_buf);
+	free(ss);
+}
@@ -23,8 +23,47 @@
 #include <string.h>
 #include <linux/ctype.h>
 #include <asm/word-at-a-time.h>
+#include <asm/unaligned.h>
 #include <malloc.h>
 
+/*
+ * Helpers for the word at a time variants of the memory and string
+ * functions below. Those work on one area aligned to a word boundary and
+ * can only use word accesses on a second area if it's equally misaligned,
+ * unless the CPU handles unaligned accesses efficiently.
+ */
+#define WORD_SIZE	sizeof(unsigned long)
+
+static inline bool word_aligned(const void *p)
+{
+	return IS_ALIGNED((unsigned long)p, WORD_SIZE);
+}
+
+static inline bool words_compatible(const void *a, const void *b)
+{
+	return IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) ||
+	       !(((unsigned long)a ^ (unsigned long)b) & (WORD_SIZE - 1));
+}
+
+/* load a word from the second area */
+static inline unsigned long load_word(const void *p)
+{
+	if (IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS))
+		return get_unaligned((const unsigned long *)p);
+
+	return *(const unsigned long *)p;
+}
+
+/*
+ * Reading a string a word at a time reads past its end up to the next
+ * word boundary. This is harmless, as aligned words never cross a page,
+ * but userspace ASAN would report it.
+ */
+static inline bool string_words_allowed(void)
+{
+	return !IS_ENABLED(CONFIG_ASAN);
+}
+
 #ifndef __HAVE_ARCH_STRCASECMP
 int strcasecmp(const char *s1, const char *s2)
 {
@@ -375,9 +414,27 @@ EXPORT_SYMBOL(_strrchr);
  */
 size_t strlen(const char * s)
 {
-	const char *sc;
+	const struct word_at_a_time constants = WORD_AT_A_TIME_CONSTANTS;
+	const char *sc = s;
+
+	if (string_words_allowed()) {
+		for (; !word_aligned(sc); ++sc)
+			if (*sc == '\0')
+				return sc - s;
 
-	for (sc = s; *sc != '\0'; ++sc)
+		for (;; sc += WORD_SIZE) {
+			unsigned long c, data;
+
+			c = read_word_at_a_time(sc);
+			if (has_zero(c, &data, &constants)) {
+				data = prep_zero_mask(c, data, &constants);
+				data = create_zero_mask(data);
+				return sc - s + find_zero(data);
+			}
+		}
+	}
+
+	for (; *sc != '\0'; ++sc)
 		/* nothing */;
 	return sc - s;
 }
@@ -392,9 +449,27 @@ EXPORT_SYMBOL(strlen);
  */
 size_t strnlen(const char * s, size_t count)
 {
-	const char *sc;
+	const struct word_at_a_time constants = WORD_AT_A_TIME_CONSTANTS;
+	const char *sc = s;
+
+	if (string_words_allowed()) {
+		for (; count && !word_aligned(sc); ++sc, count--)
+			if (*sc == '\0')
+				return sc - s;
+
+		for (; count >= WORD_SIZE; sc += WORD_SIZE, count -= WORD_SIZE) {
+			unsigned long c, data;
 
-	for (sc = s; count-- && *sc != '\0'; ++sc)
+			c = read_word_at_a_time(sc);
+			if (has_zero(c, &data, &constants)) {
+				data = prep_zero_mask(c, data, &constants);
+				data = create_zero_mask(data);
+				return sc - s + find_zero(data);
+			}
+		}
+	}
+
+	for (; count-- && *sc != '\0'; ++sc)
 		/* nothing */;
 	return sc - s;
 }
@@ -598,6 +673,18 @@ void *__default_memset(void * s, int c, size_t count)
 {
 	char *xs = (char *) s;
 
+	if (count >= 2 * WORD_SIZE) {
+		unsigned long pattern = REPEAT_BYTE((u8)c);
+
+		for (; !word_aligned(xs); count--)
+			*xs++ = c;
+
+		for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+			*(unsigned long *)xs = pattern;
+			xs += WORD_SIZE;
+		}
+	}
+
 	while (count--)
 		*xs++ = c;
 
@@ -630,12 +717,28 @@ void *__memset(void *s, int c, size_t count) __alias(__default_memset);
  * You should not use this function to access IO space, use memcpy_toio()
  * or memcpy_fromio() instead.
  */
-void *__default_memcpy(void * dest,const void *src, size_t count)
+/* also used by memmove() for overlapping areas with dest below src */
+static __always_inline void memcpy_forward(char *tmp, const char *s,
+					   size_t count)
 {
-	char *tmp = (char *) dest, *s = (char *) src;
+	if (count >= 2 * WORD_SIZE && words_compatible(tmp, s)) {
+		for (; !word_aligned(tmp); count--)
+			*tmp++ = *s++;
+
+		for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+			*(unsigned long *)tmp = load_word(s);
+			tmp += WORD_SIZE;
+			s += WORD_SIZE;
+		}
+	}
 
 	while (count--)
 		*tmp++ = *s++;
+}
+
+void *__default_memcpy(void * dest,const void *src, size_t count)
+{
+	memcpy_forward(dest, src, count);
 
 	return dest;
 }
@@ -677,20 +780,30 @@ EXPORT_SYMBOL(mempcpy);
  */
 void * memmove(void * dest,const void *src,size_t count)
 {
-	char *tmp, *s;
+	char *tmp;
+	const char *s;
 
-	if (dest <= src) {
-		tmp = (char *) dest;
-		s = (char *) src;
-		while (count--)
-			*tmp++ = *s++;
-		}
-	else {
-		tmp = (char *) dest + count;
-		s = (char *) src + count;
-		while (count--)
+	if (dest <= src || dest >= src + count) {
+		memcpy_forward(dest, src, count);
+		return dest;
+	}
+
+	tmp = (char *) dest + count;
+	s = (const char *) src + count;
+
+	if (count >= 2 * WORD_SIZE && words_compatible(tmp, s)) {
+		for (; !word_aligned(tmp); count--)
 			*--tmp = *--s;
+
+		for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+			tmp -= WORD_SIZE;
+			s -= WORD_SIZE;
+			*(unsigned long *)tmp = load_word(s);
 		}
+	}
+
+	while (count--)
+		*--tmp = *--s;
 
 	return dest;
 }
@@ -706,10 +819,24 @@ EXPORT_SYMBOL(memmove);
  */
 int memcmp(const void * cs,const void * ct,size_t count)
 {
-	const unsigned char *su1, *su2;
+	const unsigned char *su1 = cs, *su2 = ct;
 	int res = 0;
 
-	for( su1 = cs, su2 = ct; 0 < count; ++su1, ++su2, count--)
+	/* skip the equal words, the bytes loop finds the difference */
+	if (count >= 2 * WORD_SIZE && words_compatible(su1, su2)) {
+		for (; !word_aligned(su1); ++su1, ++su2, count--)
+			if ((res = *su1 - *su2) != 0)
+				return res;
+
+		for (; count >= WORD_SIZE; count -= WORD_SIZE) {
+			if (*(const unsigned long *)su1 != load_word(su2))
+				break;
+			su1 += WORD_SIZE;
+			su2 += WORD_SIZE;
+		}
+	}
+
+	for (; 0 < count; ++su1, ++su2, count--)
 		if ((res = *su1 - *su2) != 0)
 			break;
 	return res;
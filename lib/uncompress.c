@@ -26,6 +26,8 @@
 #include <malloc.h>
 #include <fs.h>
 #include <libfile.h>
+#include <linux/sizes.h>
+#include <asm/unaligned.h>
 
 static void *uncompress_buf;
 static unsigned long uncompress_size;
@@ -190,29 +192,114 @@ int uncompress_buf_to_fd(const void *input, size_t input_len,
 			  NULL, NULL, error_fn);
 }
 
-ssize_t uncompress_buf_to_buf(const void *input, size_t input_len,
-			      void **buf, void(*error_fn)(char *x))
+/**
+ * uncompress_size_hint - get the uncompressed size stored with compressed data
+ * @head:	The first bytes of the compressed data
+ * @head_len:	Length of @head
+ * @tail:	The last four bytes of the compressed data
+ *
+ * gzip stores the size of the uncompressed data modulo 4GiB in its last four
+ * bytes. This is only a hint, a concatenation of multiple gzip streams for
+ * example has the size of the last one there.
+ *
+ * Return: The size of the uncompressed data or 0 if it's not known
+ */
+size_t uncompress_size_hint(const void *head, size_t head_len,
+			    const void *tail)
+{
+	if (file_detect_type(head, head_len) == filetype_gzip)
+		return get_unaligned_le32(tail);
+
+	return 0;
+}
+
+static void *uncompress_outbuf;
+static size_t uncompress_outlen, uncompress_outsize;
+
+/*
+ * flush callback collecting the output in a buffer which is allocated
+ * with the expected size up front if that is known. The buffer size is
+ * doubled when it's exhausted to keep the number of reallocs low.
+ */
+static long flush_alloc_buf(void *buf, unsigned long len)
+{
+	if (uncompress_outlen + len > uncompress_outsize) {
+		size_t newsize = max_t(size_t, uncompress_outsize * 2, SZ_1M);
+		void *p;
+
+		while (newsize < uncompress_outlen + len)
+			newsize *= 2;
+
+		p = realloc(uncompress_outbuf, newsize);
+		if (!p)
+			return -ENOMEM;
+
+		uncompress_outbuf = p;
+		uncompress_outsize = newsize;
+	}
+
+	memcpy(uncompress_outbuf + uncompress_outlen, buf, len);
+	uncompress_outlen += len;
+
+	return len;
+}
+
+static ssize_t uncompress_to_alloc_buf(const void *input, size_t input_len,
+				       long(*fill)(void*, unsigned long),
+				       size_t size_hint, void **buf,
+				       void(*error_fn)(char *x))
 {
-	size_t size;
-	int fd, ret;
-	void *p;
+	int ret;
+
+	uncompress_outlen = uncompress_outsize = 0;
+
+	/* a wrong hint only costs memory, flush_alloc_buf() grows the buffer */
+	uncompress_outbuf = size_hint ? malloc(size_hint) : NULL;
+	if (uncompress_outbuf)
+		uncompress_outsize = size_hint;
+
+	ret = uncompress((void *)input, input_len, fill, flush_alloc_buf,
+			 NULL, NULL, error_fn);
+	if (ret) {
+		free(uncompress_outbuf);
+		return ret;
+	}
+
+	*buf = uncompress_outbuf;
 
-	fd = open("/tmp", O_TMPFILE | O_RDWR);
-	if (fd < 0)
-		return -ENODEV;
+	return uncompress_outlen;
+}
 
-	ret = uncompress_buf_to_fd(input, input_len, fd, error_fn);
-	if (ret)
-		goto close_fd;
+/**
+ * uncompress_fill_to_buf - uncompress a stream into an allocated buffer
+ * @fill:	Function called to get more compressed input
+ * @size_hint:	The expected uncompressed size or 0 if unknown
+ * @buf:	Returns the buffer containing the uncompressed data
+ * @error_fn:	Function called with error messages
+ *
+ * This uncompresses the data returned by @fill without having to buffer
+ * the compressed input. The output buffer is allocated with @size_hint
+ * bytes and only grown when the data turns out to be larger. The returned
+ * buffer must be freed by the caller.
+ *
+ * Return: The size of the uncompressed data or a negative error code
+ */
+ssize_t uncompress_fill_to_buf(long(*fill)(void*, unsigned long),
+			       size_t size_hint, void **buf,
+			       void(*error_fn)(char *x))
+{
+	return uncompress_to_alloc_buf(NULL, 0, fill, size_hint, buf, error_fn);
+}
 
-	p = read_fd(fd, &size);
-	if (p)
-		*buf = p;
-	else
-		ret = -errno;
+ssize_t uncompress_buf_to_buf(const void *input, size_t input_len,
+			      void **buf, void(*error_fn)(char *x))
+{
+	size_t size_hint = 0;
 
-close_fd:
-	close(fd);
+	if (input_len >= 32)
+		size_hint = uncompress_size_hint(input, input_len,
+						 input + input_len - 4);
 
-	return ret ?: size;
+	return uncompress_to_alloc_buf(input, input_len, NULL, size_hint,
+				       buf, error_fn);
 }
@@ -286,7 +286,10 @@ static void eth_do_work(struct eth_device *edev)
 
 	slice_acquire(eth_device_slice(edev));
 
-	edev->recv(edev);
+	if (edev->recv_batch)
+		edev->recv_batch(edev, ETH_RX_BUDGET);
+	else
+		edev->recv(edev);
 
 	list_for_each_entry_safe(q, tmp, &edev->send_queue, list) {
 		led_trigger_network(LED_TRIGGER_NET_TX);
@@ -441,6 +444,8 @@ int eth_register(struct eth_device *edev)
 	dev_add_param_enum(dev, "mode", NULL, NULL, &edev->global_mode,
 				  eth_mode_names, ARRAY_SIZE(eth_mode_names),
 				  NULL);
+	dev_add_param_uint32_ro(dev, "rx_packets", &edev->rx_packets, "%u");
+	dev_add_param_uint32_ro(dev, "rx_dropped", &edev->rx_dropped, "%u");
 
 	if (edev->init)
 		edev->init(edev);
@@ -493,6 +498,27 @@ void eth_close(struct eth_device *edev)
 	edev->active = 0;
 }
 
+/**
+ * eth_rx_pool_alloc - allocate receive buffers for a device
+ * @edev: the device
+ * @num: number of buffers
+ *
+ * Allocates @num DMA capable buffers of PKTSIZE bytes in one chunk. Drivers
+ * receiving batches of packets can use these instead of allocating each
+ * buffer themselves. The buffers are accessed with eth_rx_pool_buf() and
+ * freed by eth_unregister().
+ */
+int eth_rx_pool_alloc(struct eth_device *edev, unsigned int num)
+{
+	edev->rx_pool = dma_alloc(num * PKTSIZE);
+	if (!edev->rx_pool)
+		return -ENOMEM;
+
+	edev->rx_pool_num = num;
+
+	return 0;
+}
+
 void eth_unregister(struct eth_device *edev)
 {
 	struct eth_q *q, *tmp;
@@ -513,6 +539,7 @@ void eth_unregister(struct eth_device *edev)
 		free(edev->nodepath);
 
 	free(edev->devname);
+	dma_free(edev->rx_pool);
 
 	unregister_device(&edev->dev);
 	slice_exit(&edev->slice);
@@ -26,6 +26,7 @@
 #include <globalvar.h>
 #include <magicvar.h>
 #include <machine_id.h>
+#include <linux/bitmap.h>
 #include <linux/ctype.h>
 #include <linux/err.h>
 
@@ -441,6 +442,7 @@ static struct net_connection *net_new(struct eth_device *edev, IPaddr_t dest,
 	con->ip = (struct iphdr *)(con->packet + ETHER_HDR_SIZE);
 	con->udp = (struct udphdr *)(con->packet + ETHER_HDR_SIZE + sizeof(struct iphdr));
 	con->icmp = (struct icmphdr *)(con->packet + ETHER_HDR_SIZE + sizeof(struct iphdr));
+	con->tcp = (struct tcphdr *)(con->packet + ETHER_HDR_SIZE + sizeof(struct iphdr));
 	con->handler = handler;
 
 	if (dest == IP_BROADCAST) {
@@ -507,6 +509,22 @@ struct net_connection *net_icmp_new(IPaddr_t dest, rx_handler_f *handler,
 	return con;
 }
 
+struct net_connection *net_tcp_new(IPaddr_t dest, uint16_t dport,
+		rx_handler_f *handler, void *ctx)
+{
+	struct net_connection *con = net_new(NULL, dest, handler, ctx);
+
+	if (IS_ERR(con))
+		return con;
+
+	con->proto = IPPROTO_TCP;
+	con->tcp->th_dport = htons(dport);
+	con->tcp->th_sport = htons(net_udp_new_localport());
+	con->ip->protocol = IPPROTO_TCP;
+
+	return con;
+}
+
 void net_unregister(struct net_connection *con)
 {
 	list_del(&con->list);
@@ -532,6 +550,38 @@ int net_udp_send(struct net_connection *con, int len)
 	return net_ip_send(con, sizeof(struct udphdr) + len);
 }
 
+/*
+ * The TCP checksum covers a pseudo header made of the IP addresses, the
+ * protocol and the TCP length in addition to the segment itself.
+ */
+static uint16_t net_tcp_checksum(struct iphdr *ip, unsigned char *tcp, int len)
+{
+	uint16_t *addr = (uint16_t *)&ip->saddr;
+	uint32_t xsum;
+	int i;
+
+	xsum = net_checksum(tcp, len);
+
+	for (i = 0; i < 4; i++)
+		xsum += addr[i];
+
+	xsum += htons(IPPROTO_TCP);
+	xsum += htons(len);
+
+	xsum = (xsum & 0xffff) + (xsum >> 16);
+	xsum = (xsum & 0xffff) + (xsum >> 16);
+
+	return xsum;
+}
+
+int net_tcp_send(struct net_connection *con, int len)
+{
+	con->tcp->th_sum = 0;
+	con->tcp->th_sum = ~net_tcp_checksum(con->ip, (unsigned char *)con->tcp, len);
+
+	return net_ip_send(con, len);
+}
+
 int net_icmp_send(struct net_connection *con, int len)
 {
 	con->icmp->checksum = ~net_checksum((unsigned char *)con->icmp,
@@ -623,6 +673,7 @@ static int net_handle_arp(struct eth_device *edev, unsigned char *pkt, int len)
 	}
 
 bad:
+	edev->rx_dropped++;
 	net_bad_packet(pkt, len);
 	return -EINVAL;
 }
@@ -645,6 +696,33 @@ static int net_handle_udp(unsigned char *pkt, int len)
 	return -EINVAL;
 }
 
+static int net_handle_tcp(unsigned char *pkt, int len)
+{
+	struct iphdr *ip = net_eth_to_iphdr((char *)pkt);
+	struct tcphdr *tcp = net_eth_to_tcphdr((char *)pkt);
+	int tcplen = len - ETHER_HDR_SIZE - sizeof(struct iphdr);
+	struct net_connection *con;
+
+	if (tcplen < (int)sizeof(struct tcphdr))
+		return -EINVAL;
+
+	list_for_each_entry(con, &connection_list, list) {
+		if (con->proto != IPPROTO_TCP ||
+		    tcp->th_dport != con->tcp->th_sport ||
+		    tcp->th_sport != con->tcp->th_dport ||
+		    ip->saddr != con->ip->daddr)
+			continue;
+
+		if (net_tcp_checksum(ip, (unsigned char *)tcp, tcplen) != 0xffff)
+			return -EINVAL;
+
+		con->handler(con->priv, (char *)pkt, len);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
 static struct iphdr *ip_verify_size(unsigned char *pkt, int *total_len_nic)
 {
 	struct iphdr *ip = (struct iphdr *)(pkt + ETHER_HDR_SIZE);
@@ -700,6 +778,10 @@ static int ping_reply(struct eth_device *edev, unsigned char *pkt, int len)
 	if (!ip)
 		return -EILSEQ;
 
+	/* reassembled echo requests may not fit into a single reply packet */
+	if (len > PKTSIZE)
+		return -EMSGSIZE;
+
 	icmp->type = ICMP_ECHO_REPLY;
 	icmp->checksum = 0;
 	icmp->checksum = ~net_checksum((unsigned char *)icmp,
@@ -744,29 +826,183 @@ static int net_handle_icmp(struct eth_device *edev, unsigned char *pkt, int len)
 	return 0;
 }
 
+#define IP_FRAG_QUEUES		8
+#define IP_FRAG_MAX_PAYLOAD	(0xffff - sizeof(struct iphdr))
+#define IP_FRAG_UNITS		DIV_ROUND_UP(IP_FRAG_MAX_PAYLOAD, 8)
+#define IP_FRAG_TIMEOUT		(3 * SECOND)
+
+/*
+ * A datagram under reassembly. The buffer holds the Ethernet and IP header
+ * of the first fragment followed by the payload, so that a completed
+ * datagram looks like a single large packet to the protocol handlers.
+ */
+struct ip_frag_queue {
+	unsigned char *buf;
+	IPaddr_t saddr;
+	IPaddr_t daddr;
+	uint16_t id;
+	uint8_t protocol;
+	bool have_header;
+	unsigned int total;	/* payload length, 0 until the last fragment arrived */
+	unsigned int units;	/* number of 8 byte units received */
+	uint64_t start;
+	unsigned long map[BITS_TO_LONGS(IP_FRAG_UNITS)];
+};
+
+static struct ip_frag_queue ip_frag_queues[IP_FRAG_QUEUES];
+
+static void ip_frag_queue_free(struct ip_frag_queue *q)
+{
+	free(q->buf);
+	q->buf = NULL;
+}
+
+static struct ip_frag_queue *ip_frag_queue_get(struct iphdr *ip)
+{
+	struct ip_frag_queue *q, *victim = NULL;
+	int i;
+
+	for (i = 0; i < IP_FRAG_QUEUES; i++) {
+		q = &ip_frag_queues[i];
+
+		if (q->buf && is_timeout(q->start, IP_FRAG_TIMEOUT)) {
+			pr_debug("fragment reassembly timed out for id 0x%04x\n",
+				 ntohs(q->id));
+			ip_frag_queue_free(q);
+		}
+	}
+
+	for (i = 0; i < IP_FRAG_QUEUES; i++) {
+		q = &ip_frag_queues[i];
+
+		if (!q->buf) {
+			if (!victim || victim->buf)
+				victim = q;
+			continue;
+		}
+
+		if (q->id == ip->id && q->protocol == ip->protocol &&
+		    q->saddr == net_read_ip(&ip->saddr) &&
+		    q->daddr == net_read_ip(&ip->daddr))
+			return q;
+
+		if (!victim || (victim->buf && q->start < victim->start))
+			victim = q;
+	}
+
+	q = victim;
+	if (q->buf) {
+		pr_debug("dropping incomplete datagram id 0x%04x\n", ntohs(q->id));
+		ip_frag_queue_free(q);
+	}
+
+	q->buf = malloc(ETHER_HDR_SIZE + sizeof(struct iphdr) + IP_FRAG_MAX_PAYLOAD);
+	if (!q->buf)
+		return NULL;
+
+	q->saddr = net_read_ip(&ip->saddr);
+	q->daddr = net_read_ip(&ip->daddr);
+	q->id = ip->id;
+	q->protocol = ip->protocol;
+	q->have_header = false;
+	q->total = 0;
+	q->units = 0;
+	q->start = get_time_ns();
+	bitmap_zero(q->map, IP_FRAG_UNITS);
+
+	return q;
+}
+
+/*
+ * ip_frag_add - add a fragment to its reassembly queue
+ *
+ * Returns the queue if this fragment completed the datagram, NULL otherwise.
+ * The completed datagram is at q->buf, it has been rewritten to look like an
+ * unfragmented packet without IP options. The caller must free the queue
+ * after it has been handled.
+ */
+static struct ip_frag_queue *ip_frag_add(unsigned char *pkt, int len)
+{
+	struct iphdr *ip = net_eth_to_iphdr((char *)pkt);
+	unsigned int ihl = (ip->hl_v & 0x0f) * 4;
+	unsigned int frag = ntohs(ip->frag_off);
+	unsigned int offset = (frag & IP_OFFSET) * 8;
+	unsigned int plen, end, i;
+	struct ip_frag_queue *q;
+	struct iphdr *qip;
+
+	if (ihl < sizeof(struct iphdr) || ihl > len - ETHER_HDR_SIZE)
+		return NULL;
+
+	plen = len - ETHER_HDR_SIZE - ihl;
+	end = offset + plen;
+
+	/* all but the last fragment must carry a multiple of 8 bytes */
+	if (!plen || ((frag & IP_MF) && (plen & 7)) || end > IP_FRAG_MAX_PAYLOAD)
+		return NULL;
+
+	q = ip_frag_queue_get(ip);
+	if (!q)
+		return NULL;
+
+	if (!(frag & IP_MF)) {
+		if ((q->total && q->total != end) ||
+		    find_next_bit(q->map, IP_FRAG_UNITS, DIV_ROUND_UP(end, 8)) <
+		    IP_FRAG_UNITS)
+			goto drop;
+		q->total = end;
+	} else if (q->total && end > q->total) {
+		goto drop;
+	}
+
+	if (!offset) {
+		memcpy(q->buf, pkt, ETHER_HDR_SIZE + sizeof(struct iphdr));
+		q->have_header = true;
+	}
+
+	memcpy(q->buf + ETHER_HDR_SIZE + sizeof(struct iphdr) + offset,
+	       pkt + ETHER_HDR_SIZE + ihl, plen);
+
+	for (i = offset / 8; i < DIV_ROUND_UP(end, 8); i++)
+		if (!test_and_set_bit(i, q->map))
+			q->units++;
+
+	if (!q->have_header || !q->total || q->units != DIV_ROUND_UP(q->total, 8))
+		return NULL;
+
+	qip = net_eth_to_iphdr((char *)q->buf);
+	qip->hl_v = 0x45;
+	qip->tot_len = htons(sizeof(struct iphdr) + q->total);
+	qip->frag_off = 0;
+	qip->check = 0;
+	qip->check = ~net_checksum((unsigned char *)qip, sizeof(struct iphdr));
+
+	return q;
+drop:
+	pr_debug("inconsistent fragments for id 0x%04x\n", ntohs(q->id));
+	ip_frag_queue_free(q);
+	return NULL;
+}
+
 static int net_handle_ip(struct eth_device *edev, unsigned char *pkt, int len)
 {
 	struct iphdr *ip = (struct iphdr *)(pkt + ETHER_HDR_SIZE);
+	struct ip_frag_queue *q = NULL;
 	IPaddr_t tmp;
+	int ret = 0;
 
 	pr_debug("%s\n", __func__);
 
 	ip = ip_verify_size(pkt, &len);
 	if (!ip) {
 		pr_debug("%s: bad len\n", __func__);
+		edev->rx_dropped++;
 		return 0;
 	}
 
 	if ((ip->hl_v & 0xf0) != 0x40)
 		goto bad;
 
-	/* Can't deal w/ fragments.
-	 * Either a fragment offset (13 bits), or
-	 * MF (More Fragments) from fragment flags (3 bits).
-	 * MF - because first fragment has fragment offset 0
-	 */
-	if (ip->frag_off & htons(0x3fff))
-		goto bad;
 	if (!net_checksum_ok((unsigned char *)ip, sizeof(struct iphdr)))
 		goto bad;
 
@@ -774,15 +1010,42 @@ static int net_handle_ip(struct eth_device *edev, unsigned char *pkt, int len)
 	if (edev->ipaddr && tmp != edev->ipaddr && tmp != IP_BROADCAST)
 		return 0;
 
+	/*
+	 * A fragment has either a fragment offset (13 bits) or the
+	 * MF (More Fragments) flag set, the first fragment has offset 0.
+	 */
+	if (ip->frag_off & htons(IP_MF | IP_OFFSET)) {
+		if (!IS_ENABLED(CONFIG_NET_IP_REASSEMBLY))
+			goto bad;
+
+		q = ip_frag_add(pkt, len);
+		if (!q)
+			return 0;
+
+		pkt = q->buf;
+		ip = net_eth_to_iphdr((char *)pkt);
+		len = ETHER_HDR_SIZE + ntohs(ip->tot_len);
+	}
+
 	switch (ip->protocol) {
 	case IPPROTO_ICMP:
-		return net_handle_icmp(edev, pkt, len);
+		ret = net_handle_icmp(edev, pkt, len);
+		break;
 	case IPPROTO_UDP:
-		return net_handle_udp(pkt, len);
+		ret = net_handle_udp(pkt, len);
+		break;
+	case IPPROTO_TCP:
+		if (IS_ENABLED(CONFIG_NET_TCP))
+			ret = net_handle_tcp(pkt, len);
+		break;
 	}
 
-	return 0;
+	if (q)
+		ip_frag_queue_free(q);
+
+	return ret;
 bad:
+	edev->rx_dropped++;
 	net_bad_packet(pkt, len);
 	return 0;
 }
@@ -795,7 +1058,10 @@ int net_receive(struct eth_device *edev, unsigned char *pkt, int len)
 
 	led_trigger_network(LED_TRIGGER_NET_RX);
 
+	edev->rx_packets++;
+
 	if (len < ETHER_HDR_SIZE) {
+		edev->rx_dropped++;
 		ret = 0;
 		goto out;
 	}
@@ -810,6 +1076,7 @@ int net_receive(struct eth_device *edev, unsigned char *pkt, int len)
 		if (ret) {
 			pr_debug("%s: rx_preprocessor failed %pe\n", __func__,
 				 ERR_PTR(ret));
+			edev->rx_dropped++;
 			return ret;
 		}
 	}
@@ -823,6 +1090,7 @@ int net_receive(struct eth_device *edev, unsigned char *pkt, int len)
 		break;
 	default:
 		pr_debug("%s: got unknown protocol type: %d\n", __func__, et_protlen);
+		edev->rx_dropped++;
 		ret = 1;
 		break;
 	}
@@ -0,0 +1,692 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * tcp.c - minimal TCP client
+ *
+ * Only what is needed to fetch data from a server is implemented: active
+ * open, in order reception into a fifo with a sliding receive window and
+ * delayed ACKs, and sending with retransmission. Out of order segments are
+ * queued and answered with a duplicate ACK, so that the peer's fast
+ * retransmit fills the gap. There is no SACK, no window scaling and no
+ * listening side.
+ */
+
+#define pr_fmt(fmt) "tcp: " fmt
+
+#include <common.h>
+#include <clock.h>
+#include <errno.h>
+#include <kfifo.h>
+#include <malloc.h>
+#include <net.h>
+#include <stdlib.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/sizes.h>
+#include <asm/unaligned.h>
+
+#define TCP_RCVBUF		SZ_64K
+#define TCP_MSS			(1500 - sizeof(struct iphdr) - sizeof(struct tcphdr))
+#define TCP_DEFAULT_MSS		536
+
+#define TCP_RTO_INIT		SECOND
+#define TCP_RTO_MIN		(200 * MSECOND)
+#define TCP_RTO_MAX		(8 * SECOND)
+#define TCP_DELACK_TIMEOUT	(40 * MSECOND)
+/* give up after this many retransmissions without progress */
+#define TCP_RETRIES		6
+
+#define TCPOPT_EOL		0
+#define TCPOPT_NOP		1
+#define TCPOPT_MSS		2
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_CLOSE_WAIT,		/* peer has closed its side */
+	TCP_LAST_ACK,		/* our FIN is sent, waiting for its ACK */
+};
+
+struct tcp_segment {
+	struct list_head list;
+	uint32_t seq;
+	uint32_t len;
+	bool fin;
+	unsigned char data[];
+};
+
+struct tcp_sock {
+	struct net_connection *con;
+	enum tcp_state state;
+	int err;
+
+	uint32_t iss;
+	uint32_t snd_una;	/* oldest unacknowledged sequence number */
+	uint32_t snd_nxt;	/* next sequence number to send */
+	uint32_t snd_max;	/* highest sequence number sent */
+	uint32_t snd_wnd;
+	unsigned int mss;
+	unsigned int dupacks;
+
+	/* data currently being sent by tcp_send() */
+	const void *tx_buf;
+	size_t tx_len;
+	uint32_t tx_seq;
+
+	uint32_t rcv_nxt;
+	uint32_t rcv_adv;	/* right edge of the advertised window */
+	struct kfifo *rx;
+	bool fin_received;
+	struct list_head ooo;	/* out of order segments, sorted by sequence */
+	unsigned int ooo_bytes;
+
+	bool ack_pending;
+	unsigned int delack_segs;
+	uint64_t delack_start;
+
+	uint64_t rto;
+	uint64_t srtt;
+	uint64_t rttvar;
+	bool rtt_timing;
+	uint32_t rtt_seq;
+	uint64_t rtt_start;
+	uint64_t retrans_start;
+	unsigned int retries;
+};
+
+static inline bool seq_before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static inline bool seq_after(uint32_t a, uint32_t b)
+{
+	return seq_before(b, a);
+}
+
+static unsigned int tcp_rcv_window(struct tcp_sock *sk)
+{
+	return min_t(unsigned int, sk->rx->size - kfifo_len(sk->rx), 0xffff);
+}
+
+static int tcp_send_segment(struct tcp_sock *sk, uint8_t flags, uint32_t seq,
+			    const void *data, size_t len)
+{
+	struct tcphdr *th = sk->con->tcp;
+	unsigned char *opt = (unsigned char *)(th + 1);
+	unsigned int win, optlen = 0;
+
+	if (flags & TCP_SYN) {
+		opt[0] = TCPOPT_MSS;
+		opt[1] = 4;
+		put_unaligned_be16(TCP_MSS, &opt[2]);
+		optlen = 4;
+	}
+
+	win = tcp_rcv_window(sk);
+
+	th->th_seq = htonl(seq);
+	th->th_ack = (flags & TCP_ACK) ? htonl(sk->rcv_nxt) : 0;
+	th->th_off = ((sizeof(*th) + optlen) / 4) << 4;
+	th->th_flags = flags;
+	th->th_win = htons(win);
+	th->th_urp = 0;
+
+	if (len)
+		memcpy(opt + optlen, data, len);
+
+	if (flags & TCP_ACK) {
+		sk->rcv_adv = sk->rcv_nxt + win;
+		sk->ack_pending = false;
+		sk->delack_segs = 0;
+	}
+
+	return net_tcp_send(sk->con, sizeof(*th) + optlen + len);
+}
+
+static void tcp_send_ack(struct tcp_sock *sk)
+{
+	tcp_send_segment(sk, TCP_ACK, sk->snd_nxt, NULL, 0);
+}
+
+/* send new data from the tcp_send() buffer as far as the window allows */
+static void tcp_xmit(struct tcp_sock *sk, uint32_t wnd)
+{
+	while (sk->tx_buf) {
+		uint32_t off = sk->snd_nxt - sk->tx_seq;
+		uint32_t inflight = sk->snd_nxt - sk->snd_una;
+		size_t now;
+		uint8_t flags = TCP_ACK;
+
+		if (off >= sk->tx_len || inflight >= wnd)
+			break;
+
+		now = min3(sk->tx_len - off, (size_t)sk->mss, (size_t)(wnd - inflight));
+		if (off + now == sk->tx_len)
+			flags |= TCP_PSH;
+
+		if (!inflight)
+			sk->retrans_start = get_time_ns();
+
+		if (!sk->rtt_timing && sk->snd_nxt == sk->snd_max) {
+			sk->rtt_timing = true;
+			sk->rtt_seq = sk->snd_nxt + now;
+			sk->rtt_start = get_time_ns();
+		}
+
+		tcp_send_segment(sk, flags, sk->snd_nxt, sk->tx_buf + off, now);
+
+		sk->snd_nxt += now;
+		if (seq_after(sk->snd_nxt, sk->snd_max))
+			sk->snd_max = sk->snd_nxt;
+	}
+}
+
+static void tcp_retransmit(struct tcp_sock *sk)
+{
+	/* Karn's algorithm: no RTT samples from retransmitted segments */
+	sk->rtt_timing = false;
+	sk->retrans_start = get_time_ns();
+
+	switch (sk->state) {
+	case TCP_SYN_SENT:
+		tcp_send_segment(sk, TCP_SYN, sk->iss, NULL, 0);
+		break;
+	case TCP_LAST_ACK:
+		tcp_send_segment(sk, TCP_FIN | TCP_ACK, sk->snd_max - 1, NULL, 0);
+		break;
+	default:
+		/* go back to the oldest unacknowledged byte, probe a closed window */
+		sk->snd_nxt = sk->snd_una;
+		tcp_xmit(sk, max_t(uint32_t, sk->snd_wnd, 1));
+		break;
+	}
+}
+
+static void tcp_rtt_sample(struct tcp_sock *sk, uint64_t rtt)
+{
+	uint64_t delta;
+
+	if (!sk->srtt) {
+		sk->srtt = rtt;
+		sk->rttvar = rtt / 2;
+	} else {
+		delta = sk->srtt > rtt ? sk->srtt - rtt : rtt - sk->srtt;
+		sk->rttvar = (3 * sk->rttvar + delta) / 4;
+		sk->srtt = (7 * sk->srtt + rtt) / 8;
+	}
+
+	sk->rto = clamp_t(uint64_t, sk->srtt + 4 * sk->rttvar,
+			  TCP_RTO_MIN, TCP_RTO_MAX);
+}
+
+static int tcp_poll(struct tcp_sock *sk)
+{
+	if (ctrlc()) {
+		sk->err = -EINTR;
+		return sk->err;
+	}
+
+	net_poll();
+
+	if (sk->err)
+		return sk->err;
+
+	if (sk->ack_pending && is_timeout(sk->delack_start, TCP_DELACK_TIMEOUT))
+		tcp_send_ack(sk);
+
+	if (sk->snd_una != sk->snd_max &&
+	    is_timeout(sk->retrans_start, sk->rto)) {
+		if (++sk->retries > TCP_RETRIES) {
+			sk->err = -ETIMEDOUT;
+			return sk->err;
+		}
+
+		sk->rto = min_t(uint64_t, sk->rto * 2, TCP_RTO_MAX);
+		tcp_retransmit(sk);
+	}
+
+	return 0;
+}
+
+static void tcp_parse_options(struct tcp_sock *sk, unsigned char *opt, int len)
+{
+	while (len > 0) {
+		int optlen;
+
+		if (opt[0] == TCPOPT_EOL)
+			break;
+		if (opt[0] == TCPOPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+
+		if (len < 2)
+			break;
+		optlen = opt[1];
+		if (optlen < 2 || optlen > len)
+			break;
+
+		if (opt[0] == TCPOPT_MSS && optlen == 4)
+			sk->mss = clamp_t(unsigned int, get_unaligned_be16(&opt[2]),
+					  64, TCP_MSS);
+
+		opt += optlen;
+		len -= optlen;
+	}
+}
+
+static void tcp_handle_syn_sent(struct tcp_sock *sk, struct tcphdr *th, int hlen)
+{
+	uint32_t ack = ntohl(th->th_ack);
+	uint8_t flags = th->th_flags;
+
+	if ((flags & TCP_ACK) && ack != sk->iss + 1)
+		return;
+
+	if (flags & TCP_RST) {
+		if (flags & TCP_ACK) {
+			sk->err = -ECONNREFUSED;
+			sk->state = TCP_CLOSED;
+		}
+		return;
+	}
+
+	/* simultaneous open is not supported */
+	if ((flags & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK))
+		return;
+
+	tcp_parse_options(sk, (unsigned char *)(th + 1), hlen - sizeof(*th));
+
+	if (sk->rtt_timing)
+		tcp_rtt_sample(sk, get_time_ns() - sk->rtt_start);
+	sk->rtt_timing = false;
+
+	sk->rcv_nxt = ntohl(th->th_seq) + 1;
+	sk->snd_una = ack;
+	sk->snd_wnd = ntohs(th->th_win);
+	sk->retries = 0;
+	sk->state = TCP_ESTABLISHED;
+
+	tcp_send_ack(sk);
+}
+
+static void tcp_handle_ack(struct tcp_sock *sk, uint32_t ack, uint32_t win,
+			   bool has_data)
+{
+	if (seq_after(ack, sk->snd_max)) {
+		tcp_send_ack(sk);
+		return;
+	}
+
+	if (seq_after(ack, sk->snd_una)) {
+		if (sk->rtt_timing && !seq_before(ack, sk->rtt_seq)) {
+			tcp_rtt_sample(sk, get_time_ns() - sk->rtt_start);
+			sk->rtt_timing = false;
+		}
+
+		sk->snd_una = ack;
+		if (seq_after(ack, sk->snd_nxt))
+			sk->snd_nxt = ack;
+		sk->dupacks = 0;
+		sk->retries = 0;
+		sk->retrans_start = get_time_ns();
+	} else if (ack == sk->snd_una && sk->snd_una != sk->snd_max &&
+		   !has_data && win == sk->snd_wnd) {
+		/* fast retransmit */
+		if (++sk->dupacks == 3) {
+			sk->rtt_timing = false;
+			sk->snd_nxt = sk->snd_una;
+		}
+	}
+
+	sk->snd_wnd = win;
+
+	if (sk->state == TCP_LAST_ACK && sk->snd_una == sk->snd_max)
+		sk->state = TCP_CLOSED;
+}
+
+/*
+ * Append a segment starting at or before rcv_nxt to the receive fifo.
+ * Returns true when new data has been accepted completely and the ACK
+ * may be delayed.
+ */
+static bool tcp_accept(struct tcp_sock *sk, uint32_t seq, unsigned char *data,
+		       uint32_t len, bool fin)
+{
+	uint32_t skip = sk->rcv_nxt - seq;
+	uint32_t accepted;
+
+	if (skip > len || (skip == len && !fin))
+		return false;
+
+	data += skip;
+	len -= skip;
+
+	if (len) {
+		accepted = kfifo_put(sk->rx, data, len);
+		sk->rcv_nxt += accepted;
+
+		if (accepted < len)
+			return false;
+	}
+
+	if (fin) {
+		sk->rcv_nxt++;
+		sk->fin_received = true;
+		if (sk->state == TCP_ESTABLISHED)
+			sk->state = TCP_CLOSE_WAIT;
+		return false;
+	}
+
+	return true;
+}
+
+static void tcp_ooo_queue(struct tcp_sock *sk, uint32_t seq, unsigned char *data,
+			  uint32_t len, bool fin)
+{
+	struct tcp_segment *seg, *pos;
+
+	if (sk->ooo_bytes + len > TCP_RCVBUF || seq_after(seq + len, sk->rcv_adv))
+		return;
+
+	list_for_each_entry(pos, &sk->ooo, list) {
+		if (pos->seq == seq && pos->len >= len)
+			return;
+		if (seq_after(pos->seq, seq))
+			break;
+	}
+
+	seg = malloc(sizeof(*seg) + len);
+	if (!seg)
+		return;
+
+	seg->seq = seq;
+	seg->len = len;
+	seg->fin = fin;
+	memcpy(seg->data, data, len);
+
+	/* insert before the first segment with a higher sequence number */
+	list_add_tail(&seg->list, &pos->list);
+	sk->ooo_bytes += len;
+}
+
+/* move queued segments that are no longer out of order to the fifo */
+static void tcp_ooo_drain(struct tcp_sock *sk)
+{
+	struct tcp_segment *seg, *tmp;
+
+	list_for_each_entry_safe(seg, tmp, &sk->ooo, list) {
+		if (seq_after(seg->seq, sk->rcv_nxt))
+			break;
+
+		if (!sk->fin_received)
+			tcp_accept(sk, seg->seq, seg->data, seg->len, seg->fin);
+
+		list_del(&seg->list);
+		sk->ooo_bytes -= seg->len;
+		free(seg);
+	}
+}
+
+static void tcp_ooo_free(struct tcp_sock *sk)
+{
+	struct tcp_segment *seg, *tmp;
+
+	list_for_each_entry_safe(seg, tmp, &sk->ooo, list) {
+		list_del(&seg->list);
+		free(seg);
+	}
+
+	sk->ooo_bytes = 0;
+}
+
+static void tcp_handle_data(struct tcp_sock *sk, uint32_t seq,
+			    unsigned char *data, uint32_t len, bool fin)
+{
+	if (!len && !fin)
+		return;
+
+	if (sk->fin_received) {
+		/* our ACK of the FIN got lost */
+		tcp_send_ack(sk);
+		return;
+	}
+
+	if (seq_after(seq, sk->rcv_nxt)) {
+		/* the duplicate ACK tells the peer what is missing */
+		tcp_ooo_queue(sk, seq, data, len, fin);
+		tcp_send_ack(sk);
+		return;
+	}
+
+	if (!tcp_accept(sk, seq, data, len, fin) || !list_empty(&sk->ooo)) {
+		tcp_ooo_drain(sk);
+		tcp_send_ack(sk);
+		return;
+	}
+
+	/* delayed ACK: acknowledge every second segment or after a timeout */
+	if (++sk->delack_segs >= 2) {
+		tcp_send_ack(sk);
+	} else if (!sk->ack_pending) {
+		sk->ack_pending = true;
+		sk->delack_start = get_time_ns();
+	}
+}
+
+static void tcp_handler(void *ctx, char *pkt, unsigned int len)
+{
+	struct tcp_sock *sk = ctx;
+	struct tcphdr *th = net_eth_to_tcphdr(pkt);
+	int tcplen = len - ETHER_HDR_SIZE - sizeof(struct iphdr);
+	int hlen = (th->th_off >> 4) * 4;
+	uint32_t seq = ntohl(th->th_seq);
+	uint8_t flags = th->th_flags;
+
+	if (hlen < sizeof(*th) || hlen > tcplen)
+		return;
+
+	switch (sk->state) {
+	case TCP_CLOSED:
+		return;
+	case TCP_SYN_SENT:
+		tcp_handle_syn_sent(sk, th, hlen);
+		return;
+	default:
+		break;
+	}
+
+	if (flags & TCP_RST) {
+		if (!seq_before(seq, sk->rcv_nxt) &&
+		    seq_before(seq, sk->rcv_adv + 1)) {
+			sk->err = -ECONNRESET;
+			sk->state = TCP_CLOSED;
+		}
+		return;
+	}
+
+	/* retransmitted SYN-ACK, our ACK got lost */
+	if (flags & TCP_SYN) {
+		tcp_send_ack(sk);
+		return;
+	}
+
+	if (!(flags & TCP_ACK))
+		return;
+
+	tcp_handle_ack(sk, ntohl(th->th_ack), ntohs(th->th_win),
+		       tcplen > hlen || (flags & TCP_FIN));
+
+	tcp_handle_data(sk, seq, (unsigned char *)th + hlen, tcplen - hlen,
+			flags & TCP_FIN);
+}
+
+/**
+ * tcp_connect - open a TCP connection
+ * @dest: IP address of the server
+ * @dport: port on the server
+ *
+ * Returns the connected socket or an error pointer.
+ */
+struct tcp_sock *tcp_connect(IPaddr_t dest, uint16_t dport)
+{
+	struct tcp_sock *sk;
+	int ret;
+
+	sk = xzalloc(sizeof(*sk));
+	INIT_LIST_HEAD(&sk->ooo);
+
+	sk->rx = kfifo_alloc(TCP_RCVBUF);
+	if (!sk->rx) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	sk->con = net_tcp_new(dest, dport, tcp_handler, sk);
+	if (IS_ERR(sk->con)) {
+		ret = PTR_ERR(sk->con);
+		goto out;
+	}
+
+	sk->iss = random32();
+	sk->snd_una = sk->iss;
+	sk->snd_nxt = sk->snd_max = sk->iss + 1;
+	sk->mss = TCP_DEFAULT_MSS;
+	sk->rto = TCP_RTO_INIT;
+	sk->state = TCP_SYN_SENT;
+
+	sk->rtt_timing = true;
+	sk->rtt_seq = sk->snd_nxt;
+	sk->rtt_start = sk->retrans_start = get_time_ns();
+
+	tcp_send_segment(sk, TCP_SYN, sk->iss, NULL, 0);
+
+	while (sk->state == TCP_SYN_SENT) {
+		ret = tcp_poll(sk);
+		if (ret)
+			goto out_unregister;
+	}
+
+	if (sk->err) {
+		ret = sk->err;
+		goto out_unregister;
+	}
+
+	return sk;
+
+out_unregister:
+	net_unregister(sk->con);
+out:
+	if (sk->rx)
+		kfifo_free(sk->rx);
+	free(sk);
+
+	return ERR_PTR(ret);
+}
+
+/**
+ * tcp_send - send data over a TCP connection
+ * @sk: the socket
+ * @buf: the data
+ * @len: length of the data
+ *
+ * Returns when all data has been acknowledged by the peer. Returns @len on
+ * success or a negative error code.
+ */
+int tcp_send(struct tcp_sock *sk, const void *buf, size_t len)
+{
+	int ret = 0;
+
+	if (sk->state != TCP_ESTABLISHED && sk->state != TCP_CLOSE_WAIT)
+		return sk->err ?: -ENOTCONN;
+
+	sk->tx_buf = buf;
+	sk->tx_len = len;
+	sk->tx_seq = sk->snd_nxt;
+
+	while (sk->snd_una != sk->tx_seq + len) {
+		tcp_xmit(sk, sk->snd_wnd);
+
+		ret = tcp_poll(sk);
+		if (ret)
+			break;
+	}
+
+	sk->tx_buf = NULL;
+
+	return ret ?: len;
+}
+
+/**
+ * tcp_recv - receive data from a TCP connection
+ * @sk: the socket
+ * @buf: buffer for the data
+ * @len: size of the buffer
+ *
+ * Waits until data is available. Returns the number of bytes received,
+ * 0 when the peer has closed the connection or a negative error code.
+ */
+int tcp_recv(struct tcp_sock *sk, void *buf, size_t len)
+{
+	unsigned int now;
+	int ret;
+
+	while (1) {
+		now = kfifo_get(sk->rx, buf, len);
+		if (now)
+			break;
+
+		if (sk->fin_received)
+			return 0;
+
+		if (sk->state == TCP_CLOSED)
+			return sk->err ?: -ENOTCONN;
+
+		ret = tcp_poll(sk);
+		if (ret)
+			return ret;
+	}
+
+	/* tell the peer about the opened window once it is worth a segment or two */
+	if (sk->state == TCP_ESTABLISHED &&
+	    tcp_rcv_window(sk) >= sk->rcv_adv - sk->rcv_nxt + 2 * TCP_MSS)
+		tcp_send_ack(sk);
+
+	return now;
+}
+
+/**
+ * tcp_close - close a TCP connection and free the socket
+ * @sk: the socket
+ *
+ * A connection the peer has already closed is shut down gracefully, any
+ * other connection is reset.
+ */
+void tcp_close(struct tcp_sock *sk)
+{
+	if (IS_ERR_OR_NULL(sk))
+		return;
+
+	if (sk->state == TCP_CLOSE_WAIT && !kfifo_len(sk->rx)) {
+		sk->state = TCP_LAST_ACK;
+		sk->retries = 0;
+		sk->retrans_start = get_time_ns();
+		tcp_send_segment(sk, TCP_FIN | TCP_ACK, sk->snd_nxt, NULL, 0);
+		sk->snd_nxt = sk->snd_max = sk->snd_nxt + 1;
+
+		while (sk->state == TCP_LAST_ACK) {
+			if (tcp_poll(sk))
+				break;
+		}
+	} else if (sk->state != TCP_CLOSED && sk->state != TCP_SYN_SENT) {
+		tcp_send_segment(sk, TCP_RST | TCP_ACK, sk->snd_nxt, NULL, 0);
+	}
+
+	net_unregister(sk->con);
+	tcp_ooo_free(sk);
+	kfifo_free(sk->rx);
+	free(sk);
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <common.h>
+#include <bselftest.h>
+#include <crc.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <linux/sizes.h>
+
+BSELFTEST_GLOBALS();
+
+#define CRC32_TEST_BUF_SIZE	(SZ_4K + 64)
+
+/* bit at a time, as simple as it gets */
+static u32 crc32_reference(u32 crc, const u8 *buf, unsigned int len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+	}
+
+	return crc;
+}
+
+static void test_crc32_one(const char *name,
+			   u32 (*fn)(u32, const void *, unsigned int),
+			   const u8 *buf, unsigned int len, u32 seed)
+{
+	u32 expect = crc32_reference(seed, buf, len);
+	u32 crc = fn(seed, buf, len);
+
+	total_tests++;
+
+	if (crc != expect) {
+		failed_tests++;
+		printf("%s(0x%08x, %p, %u) = 0x%08x, but 0x%08x expected\n",
+		       name, seed, buf, len, crc, expect);
+	}
+}
+
+static void test_crc32_check(void)
+{
+	total_tests++;
+
+	if (crc32(0, "123456789", 9) != 0xcbf43926) {
+		failed_tests++;
+		printf("crc32 check value mismatch\n");
+	}
+}
+
+static void test_crc32(void)
+{
+	unsigned int len, offset, i;
+	u8 *buf;
+
+	test_crc32_check();
+
+	buf = malloc(CRC32_TEST_BUF_SIZE);
+	if (WARN_ON(!buf))
+		return;
+
+	for (i = 0; i < CRC32_TEST_BUF_SIZE; i++)
+		buf[i] = rand();
+
+	/* all alignments and all lengths around the block sizes */
+	for (offset = 0; offset < 16; offset++) {
+		for (len = 0; len < 300; len++) {
+			u32 seed = rand();
+
+			test_crc32_one("crc32_le_generic", crc32_le_generic,
+				       buf + offset, len, seed);
+			test_crc32_one("crc32_no_comp", crc32_no_comp,
+				       buf + offset, len, seed);
+		}
+	}
+
+	for (i = 0; i < 64; i++) {
+		offset = rand() % 64;
+		len = rand() % (CRC32_TEST_BUF_SIZE - offset);
+
+		test_crc32_one("crc32_no_comp", crc32_no_comp,
+			       buf + offset, len, rand());
+	}
+
+	free(buf);
+}
+bselftest(core, test_crc32);
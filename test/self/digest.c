@@ -6,6 +6,7 @@
 #include <bselftest.h>
 #include <clock.h>
 #include <digest.h>
+#include <linux/err.h>
 
 BSELFTEST_GLOBALS();
 
@@ -43,6 +44,19 @@ static inline const char *digest_suffix(const char *str, const char *suffix)
 	return buf;
 }
 
+/* for backends that are only registered if the CPU supports them */
+static bool digest_available(const char *algo)
+{
+	struct digest *d;
+
+	d = digest_alloc(algo);
+	if (!d)
+		return false;
+
+	digest_free(d);
+	return true;
+}
+
 static void __test_digest(bool option,
 			  const char *algo, struct digest_test_case *t,
 			  const char *func, int line)
@@ -131,12 +145,23 @@ static void test_digest_md5(const char *suffix)
 		TEST_CASE(inc4097, "70410aad262cd11e63ae854804c8024b"));
 }
 
+static void test_digest_crc32(const char *suffix)
+{
+	test_digest(IS_ENABLED(CONFIG_DIGEST_CRC32_GENERIC), digest_suffix("crc32", suffix),
+		TEST_CASE(zeroes7, "9d6cdf7e"),
+		TEST_CASE(one32,   "e8d05007"),
+		TEST_CASE(inc4097, "d1169ca1"));
+}
+
 static void test_digests_sha12(const char *suffix)
 {
 	bool cond;
 
 	cond = !strcmp(suffix, "generic") ? IS_ENABLED(CONFIG_DIGEST_SHA1_GENERIC) :
 	       !strcmp(suffix, "asm") ? IS_ENABLED(CONFIG_DIGEST_SHA1_ARM) :
+	       !strcmp(suffix, "ni") || !strcmp(suffix, "avx2") ?
+			IS_ENABLED(CONFIG_DIGEST_SHA1_X86) &&
+			digest_available(digest_suffix("sha1", suffix)) :
 	       IS_ENABLED(CONFIG_HAVE_DIGEST_SHA1);
 
 	test_digest(cond, digest_suffix("sha1", suffix),
@@ -148,6 +173,9 @@ static void test_digests_sha12(const char *suffix)
 	cond = !strcmp(suffix, "generic") ? IS_ENABLED(CONFIG_DIGEST_SHA224_GENERIC) :
 	       !strcmp(suffix, "asm") ? IS_ENABLED(CONFIG_DIGEST_SHA256_ARM) :
 	       !strcmp(suffix, "ce")  ? IS_ENABLED(CONFIG_DIGEST_SHA256_ARM64_CE) :
+	       !strcmp(suffix, "ni") || !strcmp(suffix, "avx2") ?
+			IS_ENABLED(CONFIG_DIGEST_SHA256_X86) &&
+			digest_available(digest_suffix("sha224", suffix)) :
 	       IS_ENABLED(CONFIG_HAVE_DIGEST_SHA224);
 
 	test_digest(cond, digest_suffix("sha224", suffix),
@@ -159,6 +187,9 @@ static void test_digests_sha12(const char *suffix)
 	cond = !strcmp(suffix, "generic") ? IS_ENABLED(CONFIG_DIGEST_SHA256_GENERIC) :
 	       !strcmp(suffix, "asm") ? IS_ENABLED(CONFIG_DIGEST_SHA256_ARM) :
 	       !strcmp(suffix, "ce")  ? IS_ENABLED(CONFIG_DIGEST_SHA256_ARM64_CE) :
+	       !strcmp(suffix, "ni") || !strcmp(suffix, "avx2") ?
+			IS_ENABLED(CONFIG_DIGEST_SHA256_X86) &&
+			digest_available(digest_suffix("sha256", suffix)) :
 	       IS_ENABLED(CONFIG_HAVE_DIGEST_SHA256);
 
 	test_digest(cond, digest_suffix("sha256", suffix),
@@ -196,6 +227,104 @@ static void test_digests_sha35(const char *suffix)
 				   "60a5a68aa0017e3446433349b42592b74713d7787628a58e400b7f588b9bd69b"));
 }
 
+/*
+ * Compare the digests of buffers of various lengths calculated at once by
+ * digest_mb() with those calculated one at a time. There are more buffers
+ * than lanes, so lanes pick up new buffers while others are still busy.
+ */
+static void test_digest_mb(bool option, const char *algo)
+{
+	static const unsigned int lens[] = {
+		0, 1, 55, 56, 63, 64, 65, 119, 120, 1000, 4000, 4096,
+	};
+	struct digest_mb_req reqs[ARRAY_SIZE(lens)];
+	u8 *out = NULL, *expect = NULL;
+	struct digest *d;
+	int i, len, ret;
+
+	total_tests++;
+
+	if (!option) {
+		skipped_tests++;
+		return;
+	}
+
+	d = digest_alloc("sha256");
+	if (!d) {
+		printf("%s: failed to allocate sha256 digest\n", algo);
+		goto fail;
+	}
+
+	len = digest_length(d);
+	out = calloc(ARRAY_SIZE(lens), len);
+	expect = calloc(ARRAY_SIZE(lens), len);
+	if (WARN_ON(!out || !expect))
+		goto fail;
+
+	for (i = 0; i < ARRAY_SIZE(lens); i++) {
+		reqs[i].data = inc4097 + i;
+		reqs[i].len = lens[i];
+		reqs[i].out = out + i * len;
+
+		digest_init(d);
+		digest_update(d, reqs[i].data, reqs[i].len);
+		digest_final(d, expect + i * len);
+	}
+
+	ret = digest_mb(algo, reqs, ARRAY_SIZE(lens));
+	if (ret == -ENOENT) {
+		/* the backend is only registered if the CPU supports it */
+		skipped_tests++;
+		goto out;
+	}
+	if (ret) {
+		printf("%s: multi-buffer digest failed: %pe\n", algo,
+		       ERR_PTR(ret));
+		goto fail;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(lens); i++) {
+		if (!memcmp(out + i * len, expect + i * len, len))
+			continue;
+
+		printf("%s: mismatch for %u bytes:\n\tgot: %*phN\n\tbut: %*phN expected\n",
+		       algo, lens[i], len, out + i * len, len, expect + i * len);
+		goto fail;
+	}
+
+out:
+	digest_free(d);
+	free(expect);
+	free(out);
+	return;
+fail:
+	digest_free(d);
+	free(expect);
+	free(out);
+	failed_tests++;
+}
+
+/* only check that the benchmark runs, its output is not checked */
+static void test_digest_bench(void)
+{
+	static const unsigned int sizes[] = { 16, 64 };
+	struct digest_bench_params params = {
+		.sizes = sizes,
+		.num_sizes = ARRAY_SIZE(sizes),
+		.align = 1,
+		.min_time_ms = 1,
+	};
+	int ret;
+
+	total_tests++;
+
+	ret = digest_bench("sha256", &params);
+	if (ret) {
+		failed_tests++;
+		printf("digest benchmark failed: %pe\n", ERR_PTR(ret));
+	}
+}
+
 static void test_digests(void)
 {
 	int i;
@@ -203,17 +332,30 @@ static void test_digests(void)
 	for (i = 0; i < ARRAY_SIZE(inc4097); i++)
 		inc4097[i] = i;
 
+	test_digest_crc32("generic");
 	test_digest_md5("generic");
 
 	test_digests_sha12("generic");
 	if (IS_ENABLED(CONFIG_CPU_32))
 		test_digests_sha12("asm");
+	if (IS_ENABLED(CONFIG_DIGEST_SHA1_X86) ||
+	    IS_ENABLED(CONFIG_DIGEST_SHA256_X86)) {
+		test_digests_sha12("ni");
+		test_digests_sha12("avx2");
+	}
 
 	test_digests_sha35("generic");
 
+	test_digest_crc32("");
 	test_digest_md5("");
 	test_digests_sha12("");
 	test_digests_sha35("");
 
+	test_digest_mb(IS_ENABLED(CONFIG_HAVE_DIGEST_SHA256), "sha256");
+	test_digest_mb(IS_ENABLED(CONFIG_DIGEST_SHA256_MB_X86), "sha256-mb-avx2");
+
+	if (IS_ENABLED(CONFIG_DIGEST_BENCH) &&
+	    IS_ENABLED(CONFIG_HAVE_DIGEST_SHA256))
+		test_digest_bench();
 }
 bselftest(core, test_digests);
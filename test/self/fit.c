@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <common.h>
+#include <bselftest.h>
+#include <console.h>
+#include <fs.h>
+#include <image-fit.h>
+#include <libfile.h>
+#include <rsa.h>
+#include <unistd.h>
+
+BSELFTEST_GLOBALS();
+
+#define FIT_TEST_DATA_SIZE	300
+
+/*
+ * A FIT image with external data, as created by mkimage -E. Its
+ * configuration is signed with the key in fit_test.pem and references the
+ * image "kernel", which has FIT_TEST_DATA_SIZE bytes of data following
+ * the FDT with data-offset = <0>. As with mkimage, the configuration was
+ * signed while the data was still embedded in the FDT, before the
+ * data-size and data-offset properties were added.
+ */
+static const u8 fit_test_external[] = {
+	0xd0, 0x0d, 0xfe, 0xed, 0x00, 0x00, 0x04, 0x54, 0x00, 0x00, 0x00, 0x38,
+	0x00, 0x00, 0x03, 0xb4, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x11,
+	0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x9f,
+	0x00, 0x00, 0x03, 0x7c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x15,
+	0x00, 0x00, 0x00, 0x00, 0x62, 0x61, 0x72, 0x65, 0x62, 0x6f, 0x78, 0x20,
+	0x46, 0x49, 0x54, 0x20, 0x73, 0x65, 0x6c, 0x66, 0x74, 0x65, 0x73, 0x74,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x04,
+	0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+	0x69, 0x6d, 0x61, 0x67, 0x65, 0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+	0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+	0x00, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x73, 0x65, 0x6c, 0x66,
+	0x74, 0x65, 0x73, 0x74, 0x20, 0x64, 0x61, 0x74, 0x61, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x20,
+	0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+	0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x25, 0x73, 0x61, 0x6e, 0x64,
+	0x62, 0x6f, 0x78, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x06,
+	0x00, 0x00, 0x00, 0x2a, 0x6c, 0x69, 0x6e, 0x75, 0x78, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x2d,
+	0x6e, 0x6f, 0x6e, 0x65, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+	0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x89, 0x00, 0x00, 0x01, 0x2c,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x93,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x68, 0x61, 0x73, 0x68,
+	0x2d, 0x31, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x20,
+	0x00, 0x00, 0x00, 0x39, 0xb6, 0xa9, 0x8f, 0x6c, 0x73, 0x80, 0x10, 0x98,
+	0x59, 0x71, 0xd9, 0x6d, 0x1e, 0xb0, 0x82, 0x9a, 0x9d, 0x96, 0x0c, 0x9a,
+	0x0b, 0xe0, 0x96, 0x05, 0x71, 0xd3, 0x85, 0x13, 0x74, 0x3e, 0x37, 0xc9,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x3f,
+	0x73, 0x68, 0x61, 0x32, 0x35, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+	0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x01,
+	0x63, 0x6f, 0x6e, 0x66, 0x69, 0x67, 0x75, 0x72, 0x61, 0x74, 0x69, 0x6f,
+	0x6e, 0x73, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x07,
+	0x00, 0x00, 0x00, 0x44, 0x63, 0x6f, 0x6e, 0x66, 0x2d, 0x31, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x01, 0x63, 0x6f, 0x6e, 0x66, 0x2d, 0x31, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x15, 0x00, 0x00, 0x00, 0x00,
+	0x73, 0x69, 0x67, 0x6e, 0x65, 0x64, 0x20, 0x63, 0x6f, 0x6e, 0x66, 0x69,
+	0x67, 0x75, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x4c,
+	0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+	0x73, 0x69, 0x67, 0x6e, 0x61, 0x74, 0x75, 0x72, 0x65, 0x2d, 0x31, 0x00,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x53,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x89, 0x00, 0x00, 0x00, 0x03,
+	0x00, 0x00, 0x00, 0x3e, 0x00, 0x00, 0x00, 0x62, 0x2f, 0x00, 0x2f, 0x63,
+	0x6f, 0x6e, 0x66, 0x69, 0x67, 0x75, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e,
+	0x73, 0x2f, 0x63, 0x6f, 0x6e, 0x66, 0x2d, 0x31, 0x00, 0x2f, 0x69, 0x6d,
+	0x61, 0x67, 0x65, 0x73, 0x2f, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x00,
+	0x2f, 0x69, 0x6d, 0x61, 0x67, 0x65, 0x73, 0x2f, 0x6b, 0x65, 0x72, 0x6e,
+	0x65, 0x6c, 0x2f, 0x68, 0x61, 0x73, 0x68, 0x2d, 0x31, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x39,
+	0x4c, 0xb1, 0xa8, 0x2b, 0xa6, 0xb0, 0x27, 0xa9, 0xad, 0x3f, 0x69, 0x74,
+	0x98, 0x60, 0xaa, 0x8c, 0xd9, 0x52, 0xef, 0x06, 0x42, 0xb5, 0x37, 0x36,
+	0xd2, 0x67, 0x97, 0xb0, 0x07, 0xb4, 0x82, 0xc5, 0x43, 0xa3, 0xcc, 0xb4,
+	0xde, 0xc0, 0x1c, 0xc7, 0xc2, 0x0c, 0xef, 0x5a, 0xc7, 0x05, 0x5d, 0x03,
+	0xba, 0x8c, 0x0a, 0x89, 0x1a, 0x7e, 0x56, 0x00, 0x08, 0x07, 0x40, 0x59,
+	0x8b, 0xcc, 0x23, 0x03, 0x7f, 0x38, 0xa3, 0xe8, 0x6b, 0x2a, 0x73, 0x9b,
+	0x34, 0x11, 0x3f, 0x14, 0xb7, 0x81, 0x63, 0xfc, 0xfd, 0x2b, 0x9f, 0x1a,
+	0x08, 0x0a, 0x74, 0x97, 0x07, 0xa2, 0xbd, 0x62, 0xd3, 0xb4, 0xee, 0x41,
+	0x0c, 0x47, 0xfc, 0xd7, 0x75, 0xe9, 0x8e, 0x64, 0xe2, 0x46, 0x16, 0x00,
+	0x9f, 0xf7, 0xd4, 0xa6, 0xc6, 0x64, 0x60, 0xd1, 0x1f, 0x1a, 0xc8, 0x5e,
+	0x77, 0xc6, 0x08, 0xf3, 0xa7, 0x7d, 0xc7, 0x03, 0x45, 0xdb, 0x05, 0xbb,
+	0x56, 0x02, 0xad, 0x4d, 0x6c, 0xf6, 0x40, 0xb4, 0x55, 0x8c, 0xd3, 0xaf,
+	0x44, 0x7b, 0x0f, 0xd9, 0x4d, 0xb2, 0x53, 0x3d, 0xa8, 0x53, 0xf5, 0xc6,
+	0x8a, 0xb4, 0xd8, 0x89, 0xff, 0x78, 0x4e, 0x44, 0x09, 0x40, 0xca, 0xa0,
+	0x1c, 0x4e, 0xaf, 0x9c, 0x7b, 0x80, 0xdc, 0xd2, 0x9f, 0x24, 0xb5, 0xb6,
+	0x99, 0x95, 0x2d, 0xf4, 0x30, 0x43, 0x34, 0xe9, 0xb6, 0xe5, 0x59, 0x48,
+	0x02, 0x73, 0xf6, 0x13, 0x01, 0xb4, 0xd2, 0xb8, 0x09, 0xde, 0xfa, 0x94,
+	0xdf, 0x97, 0x44, 0x2b, 0x73, 0xf0, 0xa5, 0x21, 0x0e, 0x99, 0xd5, 0x4d,
+	0x17, 0xbc, 0x49, 0x29, 0x8e, 0x82, 0x98, 0xf5, 0x39, 0x00, 0x1b, 0xec,
+	0x61, 0xb5, 0xe7, 0x3e, 0x43, 0x95, 0x1d, 0x7c, 0x36, 0x2a, 0xaf, 0x6a,
+	0x9c, 0xb5, 0x74, 0x0b, 0x50, 0x1b, 0x71, 0xa7, 0xb5, 0x3f, 0xf6, 0x68,
+	0x60, 0x73, 0xe4, 0xbc, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0f,
+	0x00, 0x00, 0x00, 0x3f, 0x73, 0x68, 0x61, 0x32, 0x35, 0x36, 0x2c, 0x72,
+	0x73, 0x61, 0x32, 0x30, 0x34, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+	0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x6f, 0x66, 0x69, 0x74, 0x5f,
+	0x74, 0x65, 0x73, 0x74, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+	0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x7d, 0x6b, 0x65, 0x72, 0x6e,
+	0x65, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02,
+	0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x09,
+	0x64, 0x65, 0x73, 0x63, 0x72, 0x69, 0x70, 0x74, 0x69, 0x6f, 0x6e, 0x00,
+	0x23, 0x61, 0x64, 0x64, 0x72, 0x65, 0x73, 0x73, 0x2d, 0x63, 0x65, 0x6c,
+	0x6c, 0x73, 0x00, 0x64, 0x61, 0x74, 0x61, 0x00, 0x74, 0x79, 0x70, 0x65,
+	0x00, 0x61, 0x72, 0x63, 0x68, 0x00, 0x6f, 0x73, 0x00, 0x63, 0x6f, 0x6d,
+	0x70, 0x72, 0x65, 0x73, 0x73, 0x69, 0x6f, 0x6e, 0x00, 0x76, 0x61, 0x6c,
+	0x75, 0x65, 0x00, 0x61, 0x6c, 0x67, 0x6f, 0x00, 0x64, 0x65, 0x66, 0x61,
+	0x75, 0x6c, 0x74, 0x00, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x00, 0x68,
+	0x61, 0x73, 0x68, 0x65, 0x64, 0x2d, 0x73, 0x74, 0x72, 0x69, 0x6e, 0x67,
+	0x73, 0x00, 0x68, 0x61, 0x73, 0x68, 0x65, 0x64, 0x2d, 0x6e, 0x6f, 0x64,
+	0x65, 0x73, 0x00, 0x6b, 0x65, 0x79, 0x2d, 0x6e, 0x61, 0x6d, 0x65, 0x2d,
+	0x68, 0x69, 0x6e, 0x74, 0x00, 0x73, 0x69, 0x67, 0x6e, 0x2d, 0x69, 0x6d,
+	0x61, 0x67, 0x65, 0x73, 0x00, 0x64, 0x61, 0x74, 0x61, 0x2d, 0x73, 0x69,
+	0x7a, 0x65, 0x00, 0x64, 0x61, 0x74, 0x61, 0x2d, 0x6f, 0x66, 0x66, 0x73,
+	0x65, 0x74, 0x00, 0x00, 0x00, 0x07, 0x0e, 0x15, 0x1c, 0x23, 0x2a, 0x31,
+	0x39, 0x40, 0x47, 0x4e, 0x55, 0x5c, 0x63, 0x6a, 0x72, 0x79, 0x80, 0x87,
+	0x8e, 0x95, 0x9c, 0xa3, 0xab, 0xb2, 0xb9, 0xc0, 0xc7, 0xce, 0xd5, 0xdc,
+	0xe4, 0xeb, 0xf2, 0xf9, 0x00, 0x07, 0x0e, 0x15, 0x1d, 0x24, 0x2b, 0x32,
+	0x39, 0x40, 0x47, 0x4e, 0x56, 0x5d, 0x64, 0x6b, 0x72, 0x79, 0x80, 0x87,
+	0x8f, 0x96, 0x9d, 0xa4, 0xab, 0xb2, 0xb9, 0xc0, 0xc8, 0xcf, 0xd6, 0xdd,
+	0xe4, 0xeb, 0xf2, 0xf9, 0x01, 0x08, 0x0f, 0x16, 0x1d, 0x24, 0x2b, 0x32,
+	0x3a, 0x41, 0x48, 0x4f, 0x56, 0x5d, 0x64, 0x6b, 0x73, 0x7a, 0x81, 0x88,
+	0x8f, 0x96, 0x9d, 0xa4, 0xac, 0xb3, 0xba, 0xc1, 0xc8, 0xcf, 0xd6, 0xdd,
+	0xe5, 0xec, 0xf3, 0xfa, 0x01, 0x08, 0x0f, 0x16, 0x1e, 0x25, 0x2c, 0x33,
+	0x3a, 0x41, 0x48, 0x4f, 0x57, 0x5e, 0x65, 0x6c, 0x73, 0x7a, 0x81, 0x88,
+	0x90, 0x97, 0x9e, 0xa5, 0xac, 0xb3, 0xba, 0xc1, 0xc9, 0xd0, 0xd7, 0xde,
+	0xe5, 0xec, 0xf3, 0xfa, 0x02, 0x09, 0x10, 0x17, 0x1e, 0x25, 0x2c, 0x33,
+	0x3b, 0x42, 0x49, 0x50, 0x57, 0x5e, 0x65, 0x6c, 0x74, 0x7b, 0x82, 0x89,
+	0x90, 0x97, 0x9e, 0xa5, 0xad, 0xb4, 0xbb, 0xc2, 0xc9, 0xd0, 0xd7, 0xde,
+	0xe6, 0xed, 0xf4, 0xfb, 0x02, 0x09, 0x10, 0x17, 0x1f, 0x26, 0x2d, 0x34,
+	0x3b, 0x42, 0x49, 0x50, 0x58, 0x5f, 0x66, 0x6d, 0x74, 0x7b, 0x82, 0x89,
+	0x91, 0x98, 0x9f, 0xa6, 0xad, 0xb4, 0xbb, 0xc2, 0xca, 0xd1, 0xd8, 0xdf,
+	0xe6, 0xed, 0xf4, 0xfb, 0x03, 0x0a, 0x11, 0x18, 0x1f, 0x26, 0x2d, 0x34,
+	0x3c, 0x43, 0x4a, 0x51, 0x58, 0x5f, 0x66, 0x6d, 0x75, 0x7c, 0x83, 0x8a,
+	0x91, 0x98, 0x9f, 0xa6, 0xae, 0xb5, 0xbc, 0xc3, 0xca, 0xd1, 0xd8, 0xdf,
+	0xe7, 0xee, 0xf5, 0xfc, 0x03, 0x0a, 0x11, 0x18, 0x20, 0x27, 0x2e, 0x35,
+	0x3c, 0x43, 0x4a, 0x51, 0x59, 0x60, 0x67, 0x6e, 0x75, 0x7c, 0x83, 0x8a,
+	0x92, 0x99, 0xa0, 0xa7, 0xae, 0xb5, 0xbc, 0xc3, 0xcb, 0xd2, 0xd9, 0xe0,
+	0xe7, 0xee, 0xf5, 0xfc, 0x04, 0x0b, 0x12, 0x19, 0x20, 0x27, 0x2e, 0x35,
+	0x3d, 0x44, 0x4b, 0x52,
+};
+
+static void fit_test_data(u8 *buf)
+{
+	int i;
+
+	for (i = 0; i < FIT_TEST_DATA_SIZE; i++)
+		buf[i] = i * 7 + (i >> 3);
+}
+
+/* returns 0 if the kernel image of configuration conf-1 has the expected data */
+static int fit_test_open(struct fit_handle *handle)
+{
+	u8 expect[FIT_TEST_DATA_SIZE];
+	unsigned long len;
+	const void *data;
+	void *conf;
+	int ret;
+
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	conf = fit_open_configuration(handle, "conf-1");
+	if (IS_ERR(conf)) {
+		ret = PTR_ERR(conf);
+		goto out;
+	}
+
+	ret = fit_open_image(handle, conf, "kernel", &data, &len);
+	if (ret)
+		goto out;
+
+	fit_test_data(expect);
+	if (len != FIT_TEST_DATA_SIZE || memcmp(data, expect, len))
+		ret = -EILSEQ;
+out:
+	fit_close(handle);
+
+	return ret;
+}
+
+static void fit_test_expect(int ret, bool expect_ok, const char *what)
+{
+	total_tests++;
+
+	if ((ret == 0) != expect_ok) {
+		failed_tests++;
+		printf("%s: %s: %pe\n", what,
+		       expect_ok ? "failed" : "unexpectedly succeeded",
+		       ERR_PTR(ret));
+	}
+}
+
+/* flip a byte of the string @str in @buf */
+static void fit_test_mangle(u8 *buf, size_t len, const char *str)
+{
+	size_t i, n = strlen(str);
+
+	for (i = 0; i + n <= len; i++) {
+		if (!memcmp(buf + i, str, n)) {
+			buf[i] ^= 1;
+			return;
+		}
+	}
+
+	WARN_ON(1);
+}
+
+static void test_fit_external_signed(void)
+{
+	extern struct rsa_public_key __key_fit_test;
+	const size_t size = sizeof(fit_test_external);
+	int old_loglevel, ret;
+	char *fname;
+	u8 *buf;
+
+	ret = rsa_key_add(&__key_fit_test);
+	if (ret) {
+		fit_test_expect(ret, true, "adding the test key");
+		return;
+	}
+
+	buf = xmemdup(fit_test_external, size);
+
+	ret = fit_test_open(fit_open_buf(buf, size, false,
+					 BOOTM_VERIFY_SIGNATURE));
+	fit_test_expect(ret, true, "signed FIT with external data in memory");
+
+	fname = make_temp("fit-test");
+	ret = write_file(fname, buf, size);
+	if (ret) {
+		fit_test_expect(ret, true, "writing the FIT to a file");
+	} else {
+		ret = fit_test_open(fit_open(fname, false, BOOTM_VERIFY_SIGNATURE,
+					     FILESIZE_MAX));
+		fit_test_expect(ret, true, "signed FIT with external data from file");
+		unlink(fname);
+	}
+	free(fname);
+
+	/* the following tests are expected to fail loudly */
+	old_loglevel = barebox_set_loglevel(MSG_CRIT);
+
+	fit_test_mangle(buf, size, "selftest data");
+	ret = fit_test_open(fit_open_buf(buf, size, false,
+					 BOOTM_VERIFY_SIGNATURE));
+	fit_test_expect(ret, false, "FIT with modified image node");
+
+	memcpy(buf, fit_test_external, size);
+	buf[size - 1] ^= 1;
+	ret = fit_test_open(fit_open_buf(buf, size, false,
+					 BOOTM_VERIFY_SIGNATURE));
+	fit_test_expect(ret, false, "FIT with modified external data");
+
+	barebox_set_loglevel(old_loglevel);
+
+	free(buf);
+	rsa_key_remove(&__key_fit_test);
+}
+bselftest(core, test_fit_external_signed);
@@ -214,3 +214,124 @@ static void test_ramfs(void)
 	free(dname);
 }
 bselftest(core, test_ramfs);
+
+static void test_ramfs_large_file(void)
+{
+	const size_t size = SZ_1M + 123, piece = 4099;
+	char *fname, *buf = NULL, *map;
+	size_t ofs, i;
+	int ret, fd;
+
+	fname = make_temp("ramfs-large");
+
+	fd = open(fname, O_RDWR | O_CREAT);
+	if (!expect_success(fd, "creating file"))
+		goto out;
+
+	buf = malloc(size);
+	if (WARN_ON(!buf))
+		goto out_close;
+
+	for (i = 0; i < size; i++)
+		buf[i] = i * 13 + (i >> 12);
+
+	/* extend the file in small pieces like a network download would */
+	for (ofs = 0; ofs < size; ofs += piece) {
+		ret = write_full(fd, buf + ofs, min(piece, size - ofs));
+		if (!expect_success(ret, "writing piece at %zu", ofs))
+			goto out_close;
+	}
+
+	close(fd);
+
+	fd = open(fname, O_RDWR);
+	if (!expect_success(fd, "reopening file"))
+		goto out;
+
+	map = memmap(fd, PROT_READ);
+	if (expect_success(map == MAP_FAILED ? -EINVAL : 0, "memmap()"))
+		expect_success(memcmp(map, buf, size) ? -EINVAL : 0,
+			       "memmapped content");
+
+	ret = ftruncate(fd, SZ_64K);
+	expect_success(ret, "truncating down");
+
+	ret = ftruncate(fd, SZ_256K);
+	expect_success(ret, "truncating up");
+
+	ret = pread_full(fd, buf + SZ_64K, SZ_256K - SZ_64K, SZ_64K);
+	expect_success(ret == SZ_256K - SZ_64K ? 0 : -EIO, "reading back");
+
+	for (i = SZ_64K; i < SZ_256K; i++) {
+		if (!expect_success(buf[i] ? -EINVAL : 0,
+				    "non-zero byte at %zu after truncate", i))
+			break;
+	}
+
+out_close:
+	close(fd);
+out:
+	free(buf);
+	unlink(fname);
+	free(fname);
+}
+bselftest(core, test_ramfs_large_file);
+
+static void test_ramfs_grow_mapped(void)
+{
+	const size_t size = SZ_64K;
+	char *fname, *buf = NULL, *map;
+	int ret, fd, fd2;
+	size_t i;
+
+	fname = make_temp("ramfs-mapped");
+
+	fd = open(fname, O_RDWR | O_CREAT);
+	if (!expect_success(fd, "creating file"))
+		goto out;
+
+	buf = malloc(2 * size);
+	if (WARN_ON(!buf))
+		goto out_close;
+
+	for (i = 0; i < 2 * size; i++)
+		buf[i] = i * 7 + (i >> 10);
+
+	ret = write_full(fd, buf, size);
+	if (!expect_success(ret, "writing file"))
+		goto out_close;
+
+	map = memmap(fd, PROT_READ);
+	if (!expect_success(map == MAP_FAILED ? -EINVAL : 0, "memmap()"))
+		goto out_close;
+
+	/* growing the file through another descriptor must not move the data */
+	fd2 = open(fname, O_RDWR);
+	if (!expect_success(fd2, "opening file again"))
+		goto out_close;
+
+	ret = pwrite_full(fd2, buf + size, size, size);
+	expect_success(ret == (int)size ? 0 : -EIO, "appending to mapped file");
+
+	expect_success(memcmp(map, buf, size) ? -EINVAL : 0,
+		       "memmapped content after append");
+
+	memset(buf + size, 0, size);
+	ret = pread_full(fd2, buf + size, size, size);
+	expect_success(ret == (int)size ? 0 : -EIO, "reading appended data");
+
+	for (i = size; i < 2 * size; i++) {
+		if (!expect_success(buf[i] == (char)(i * 7 + (i >> 10)) ? 0 : -EINVAL,
+				    "wrong byte at %zu", i))
+			break;
+	}
+
+	close(fd2);
+out_close:
+	close(fd);
+out:
+	free(buf);
+	unlink(fname);
+	free(fname);
+}
+bselftest(core, test_ramfs_grow_mapped);
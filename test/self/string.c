@@ -4,6 +4,8 @@
 
 #include <common.h>
 #include <bselftest.h>
+#include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 
 BSELFTEST_GLOBALS();
@@ -195,9 +197,170 @@ static void test_strjoin(void)
 	expect_dynstreq(strjoin(" ",   NULL, 0),                "");
 }
 
+#define STRING_TEST_BUF_SIZE	1024
+#define STRING_TEST_ROUNDS	2000
+
+/* byte at a time references for the optimized memory and string functions */
+static void memcpy_reference(u8 *dest, const u8 *src, size_t count)
+{
+	while (count--)
+		*dest++ = *src++;
+}
+
+static void memmove_reference(u8 *dest, const u8 *src, size_t count)
+{
+	if (dest <= src) {
+		memcpy_reference(dest, src, count);
+		return;
+	}
+
+	while (count--)
+		dest[count] = src[count];
+}
+
+static int memcmp_reference(const u8 *a, const u8 *b, size_t count)
+{
+	for (; count; a++, b++, count--)
+		if (*a != *b)
+			return *a - *b;
+
+	return 0;
+}
+
+static size_t strnlen_reference(const char *s, size_t count)
+{
+	size_t len = 0;
+
+	while (len < count && s[len])
+		len++;
+
+	return len;
+}
+
+static void fill_random(u8 *buf, size_t len)
+{
+	while (len--)
+		*buf++ = rand();
+}
+
+static void __expect_mem(const char *func, const char *name, const u8 *is,
+			 const u8 *expect, size_t dest, size_t src, size_t len)
+{
+	total_tests++;
+
+	if (memcmp_reference(is, expect, STRING_TEST_BUF_SIZE)) {
+		failed_tests++;
+		printf("%s: %s(buf + %zu, buf + %zu, %zu) mismatch\n",
+		       func, name, dest, src, len);
+	}
+}
+
+#define expect_mem(args...) __expect_mem(__func__, args)
+
+static int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+/*
+ * Compare the optimized functions against the references with random
+ * lengths, alignments and contents. The whole buffers are compared, so
+ * that writes outside of the area are noticed as well.
+ */
+static void test_string_fuzz(void)
+{
+	u8 *buf, *expect, *src;
+	int i;
+
+	buf = malloc(STRING_TEST_BUF_SIZE);
+	expect = malloc(STRING_TEST_BUF_SIZE);
+	src = malloc(STRING_TEST_BUF_SIZE);
+	if (WARN_ON(!buf || !expect || !src))
+		goto out;
+
+	for (i = 0; i < STRING_TEST_ROUNDS; i++) {
+		size_t len = rand() % (STRING_TEST_BUF_SIZE / 2);
+		size_t doff = rand() % 16, soff = rand() % 16;
+		size_t moff = STRING_TEST_BUF_SIZE / 4 + rand() % 64;
+		int c = rand(), ret;
+		size_t j;
+
+		fill_random(buf, STRING_TEST_BUF_SIZE);
+		fill_random(src, STRING_TEST_BUF_SIZE);
+
+		memcpy_reference(expect, buf, STRING_TEST_BUF_SIZE);
+		memcpy_reference(expect + doff, src + soff, len);
+		memcpy_reference(buf, expect, STRING_TEST_BUF_SIZE);
+		fill_random(buf + doff, len);
+		memcpy(buf + doff, src + soff, len);
+		expect_mem("memcpy", buf, expect, doff, soff, len);
+
+		fill_random(buf + doff, len);
+		__default_memcpy(buf + doff, src + soff, len);
+		expect_mem("__default_memcpy", buf, expect, doff, soff, len);
+
+		memcpy_reference(buf, expect, STRING_TEST_BUF_SIZE);
+		for (j = 0; j < len; j++)
+			expect[doff + j] = c;
+		memset(buf + doff, c, len);
+		expect_mem("memset", buf, expect, doff, 0, len);
+
+		memcpy_reference(buf, expect, STRING_TEST_BUF_SIZE);
+		fill_random(buf + doff, len);
+		__default_memset(buf + doff, c, len);
+		expect_mem("__default_memset", buf, expect, doff, 0, len);
+
+		/* overlapping in both directions */
+		fill_random(buf, STRING_TEST_BUF_SIZE);
+		memcpy_reference(expect, buf, STRING_TEST_BUF_SIZE);
+		memmove_reference(expect + moff + doff, expect + moff + soff, len);
+		memmove(buf + moff + doff, buf + moff + soff, len);
+		expect_mem("memmove", buf, expect, moff + doff, moff + soff, len);
+
+		memcpy_reference(buf + doff, src + soff, len);
+		if (len && rand() % 2)
+			buf[doff + rand() % len] ^= 1 + rand() % 255;
+		ret = memcmp(buf + doff, src + soff, len);
+		total_tests++;
+		if (sign(ret) != sign(memcmp_reference(buf + doff, src + soff, len))) {
+			failed_tests++;
+			printf("memcmp(buf + %zu, src + %zu, %zu) = %d mismatch\n",
+			       doff, soff, len, ret);
+		}
+
+		/* a string of len bytes, maybe with an earlier terminator */
+		for (j = 0; j < len; j++)
+			buf[doff + j] |= 1;
+		buf[doff + len] = '\0';
+		if (rand() % 4 == 0)
+			buf[doff + rand() % (len + 1)] = '\0';
+
+		total_tests++;
+		if (strlen((char *)buf + doff) !=
+		    strnlen_reference((char *)buf + doff, SIZE_MAX)) {
+			failed_tests++;
+			printf("strlen(buf + %zu) mismatch\n", doff);
+		}
+
+		c = rand() % (len + 32);
+		total_tests++;
+		if (strnlen((char *)buf + doff, c) !=
+		    strnlen_reference((char *)buf + doff, c)) {
+			failed_tests++;
+			printf("strnlen(buf + %zu, %d) mismatch\n", doff, c);
+		}
+	}
+
+out:
+	free(src);
+	free(expect);
+	free(buf);
+}
+
 static void test_string(void)
 {
 	test_strverscmp();
 	test_strjoin();
+	test_string_fuzz();
 }
 bselftest(parser, test_string);